@@ -0,0 +1,394 @@
+/*
+Benchmark
+
+Second unity build next to ray_main.cpp, renders every scene with every preset and reports
+the median of the timed runs, so optimizations can be compared against a previous run.
+
+RayBenchmark [-scene default|file.rscn]... [-preset name]... [-size width height]
+             [-warmup count] [-repeat count] [-seed seed] [-baseline benchmark.csv]
+
+without -scene the built in scene is used, without -preset minimal and dev are run.
+results go to benchmark.csv and benchmark.json, an existing benchmark.csv should be renamed
+and passed as -baseline to get the speedup of every scene and preset pair.
+
+every run renders with randomSeed set to seed, so the random numbers of every sample and the
+ray counts are the same in every run. all presets are rendered with RayTraceImage, progressive
+passes and streamed output are not part of the timing. presets with cachePrimaryHits render
+once and then time ReshadeImage, their ray counts have no primary rays.
+*/
+#define RAY_BENCHMARK 1
+#include "ray_main.cpp"
+
+#define BENCHMARK_MAX_ENTRIES 32
+#define BENCHMARK_MAX_REPEATS 256
+#define BenchmarkCSVFile "benchmark.csv"
+#define BenchmarkJSONFile "benchmark.json"
+
+struct BenchmarkResult {
+    char* sceneName;
+    char* presetName;
+    
+    U64 medianMicroseconds;
+    U64 minMicroseconds;
+    U64 maxMicroseconds;
+    
+    //NOTE(ans): primary, shadow and reflection rays of one run
+    U64 rayCount;
+    U64 sampleCount;
+    
+    double raysPerSecond;
+    double samplesPerSecond;
+};
+
+struct BenchmarkSettings {
+    char* sceneNames[BENCHMARK_MAX_ENTRIES];
+    U32 sceneCount;
+    char* presetNames[BENCHMARK_MAX_ENTRIES];
+    U32 presetCount;
+    
+    U32 imageWidth;
+    U32 imageHeight;
+    U32 warmupCount;
+    U32 repeatCount;
+    U32 seed;
+    
+    char* baselineFileName;
+};
+
+static bool ParseBenchmarkArguments(int argumentCount, char** arguments, BenchmarkSettings* settings) {
+    settings->sceneCount = 0;
+    settings->presetCount = 0;
+    settings->imageWidth = 1280;
+    settings->imageHeight = 720;
+    settings->warmupCount = 1;
+    settings->repeatCount = 5;
+    settings->seed = 1;
+    settings->baselineFileName = 0;
+    
+    for(int argumentIndex = 1; argumentIndex < argumentCount; ++argumentIndex) {
+        char* argument = arguments[argumentIndex];
+        int valuesLeft = argumentCount - argumentIndex - 1;
+        
+        if(strcmp(argument, "-scene") == 0 && valuesLeft >= 1 && settings->sceneCount < BENCHMARK_MAX_ENTRIES) {
+            settings->sceneNames[settings->sceneCount++] = arguments[++argumentIndex];
+        } else if(strcmp(argument, "-preset") == 0 && valuesLeft >= 1 && settings->presetCount < BENCHMARK_MAX_ENTRIES) {
+            settings->presetNames[settings->presetCount++] = arguments[++argumentIndex];
+        } else if(strcmp(argument, "-size") == 0 && valuesLeft >= 2) {
+            settings->imageWidth = (U32)atoi(arguments[++argumentIndex]);
+            settings->imageHeight = (U32)atoi(arguments[++argumentIndex]);
+        } else if(strcmp(argument, "-warmup") == 0 && valuesLeft >= 1) {
+            settings->warmupCount = (U32)atoi(arguments[++argumentIndex]);
+        } else if(strcmp(argument, "-repeat") == 0 && valuesLeft >= 1) {
+            settings->repeatCount = (U32)atoi(arguments[++argumentIndex]);
+        } else if(strcmp(argument, "-seed") == 0 && valuesLeft >= 1) {
+            settings->seed = (U32)atoi(arguments[++argumentIndex]);
+        } else if(strcmp(argument, "-baseline") == 0 && valuesLeft >= 1) {
+            settings->baselineFileName = arguments[++argumentIndex];
+        } else {
+            fprintf(stderr, "Unknown benchmark argument %s . . .", argument);
+            
+            return false;
+        }
+    }
+    
+    if(settings->sceneCount == 0) {
+        settings->sceneNames[settings->sceneCount++] = "default";
+    }
+    
+    if(settings->presetCount == 0) {
+        settings->presetNames[settings->presetCount++] = "minimal";
+        settings->presetNames[settings->presetCount++] = "dev";
+    }
+    
+    if(settings->imageWidth == 0 || settings->imageHeight == 0 ||
+       settings->repeatCount == 0 || settings->repeatCount > BENCHMARK_MAX_REPEATS) {
+        fprintf(stderr, "Benchmark size and repeat count have to be between 1 and %d . . .", BENCHMARK_MAX_REPEATS);
+        
+        return false;
+    }
+    
+    return true;
+}
+
+static U64 MedianU64(U64* values, U32 count) {
+    //NOTE(ans): insertion sort, there are only a few repeats
+    for(U32 index = 1; index < count; ++index) {
+        U64 value = values[index];
+        U32 insertIndex = index;
+        while(insertIndex > 0 && values[insertIndex - 1] > value) {
+            values[insertIndex] = values[insertIndex - 1];
+            --insertIndex;
+        }
+        values[insertIndex] = value;
+    }
+    
+    U64 result = values[count / 2];
+    if(count % 2 == 0) {
+        result = (values[count / 2 - 1] + values[count / 2]) / 2;
+    }
+    
+    return result;
+}
+
+static BenchmarkResult RunBenchmark(RenderContext* context, BenchmarkSettings* settings,
+                                    World* world, V3 cameraP, Options* presetOptions, V3* hdrPixelData) {
+    Options runOptions = *presetOptions;
+    runOptions.randomSeed = settings->seed;
+    Options* options = &runOptions;
+    
+    U32 imageWidth = settings->imageWidth;
+    U32 imageHeight = settings->imageHeight;
+    
+    RenderCamera camera = SetupCamera(cameraP, imageWidth, imageHeight);
+    
+    SAAData saaData;
+    CalculateSAAData(options->saaMode,
+                     camera.filmWidth, camera.filmHeight,
+                     imageWidth, imageHeight,
+                     camera.cameraX, camera.cameraY,
+                     &saaData);
+    
+    U64 microseconds[BENCHMARK_MAX_REPEATS];
+    
+    //NOTE(ans): presets that cache the primary hits record them once and time ReshadeImage
+    bool reshade = false;
+    if(options->cachePrimaryHits) {
+        RayTraceImage(context,
+                      imageHeight, imageWidth,
+                      camera.cameraP, camera.cameraX, camera.cameraY,
+                      camera.filmWidthHalf, camera.filmHeightHalf, camera.filmC,
+                      world,
+                      hdrPixelData,
+                      0,
+                      options,
+                      &saaData);
+        
+        reshade = context->gBuffer.recorded;
+    }
+    
+    //NOTE(ans): 
+    // the runs only compare when they trace the same rays, different ray counts mean
+    // some random numbers do not come from randomSeed
+    U64 firstRayCount = 0;
+    bool rayCountsMatch = true;
+    
+    U32 runCount = settings->warmupCount + settings->repeatCount;
+    for(U32 runIndex = 0; runIndex < runCount; ++runIndex) {
+        U64 startTimeStamp = GetTimeStamp();
+        
+        if(reshade) {
+            ReshadeImage(context, world, hdrPixelData, 0, options);
+        } else {
+            RayTraceImage(context,
+                          imageHeight, imageWidth,
+                          camera.cameraP, camera.cameraX, camera.cameraY,
+                          camera.filmWidthHalf, camera.filmHeightHalf, camera.filmC,
+                          world,
+                          hdrPixelData,
+                          0,
+                          options,
+                          &saaData);
+        }
+        
+        U64 endTimeStamp = GetTimeStamp();
+        
+        if(runIndex >= settings->warmupCount) {
+            microseconds[runIndex - settings->warmupCount] = endTimeStamp - startTimeStamp;
+        }
+        
+        RayTraceStats runStats = context->stats;
+        U64 runRayCount = runStats.primaryRayCount + runStats.shadowRayCount + runStats.reflectionRayCount;
+        if(runIndex == 0) {
+            firstRayCount = runRayCount;
+        } else if(runRayCount != firstRayCount) {
+            rayCountsMatch = false;
+        }
+    }
+    
+    if(!rayCountsMatch) {
+        fprintf(stderr, "The ray counts of the runs differ, the runs are not deterministic . . .\n");
+    }
+    
+    //NOTE(ans): MedianU64 sorts the times, so the first and last are the fastest and slowest run
+    BenchmarkResult result = {};
+    result.medianMicroseconds = MedianU64(microseconds, settings->repeatCount);
+    result.minMicroseconds = microseconds[0];
+    result.maxMicroseconds = microseconds[settings->repeatCount - 1];
+    
+    RayTraceStats stats = context->stats;
+    result.rayCount = stats.primaryRayCount + stats.shadowRayCount + stats.reflectionRayCount;
+    result.sampleCount = stats.primaryRayCount;
+    
+    double seconds = (double)result.medianMicroseconds / 1000000.0;
+    if(seconds > 0) {
+        result.raysPerSecond = (double)result.rayCount / seconds;
+        result.samplesPerSecond = (double)result.sampleCount / seconds;
+    }
+    
+    return result;
+}
+
+//NOTE(ans): returns 0 when the baseline has no entry for the pair
+static U64 FindBaselineMicroseconds(char* baselineFileName, char* sceneName, char* presetName) {
+    FILE* file = fopen(baselineFileName, "r");
+    if(!file) {
+        return 0;
+    }
+    
+    U64 result = 0;
+    
+    char line[1024];
+    while(fgets(line, sizeof(line), file)) {
+        char lineScene[512];
+        char linePreset[256];
+        U64 medianMicroseconds;
+        
+        if(sscanf(line, "%511[^,],%255[^,],%*u,%*u,%*u,%llu", lineScene, linePreset, &medianMicroseconds) == 3 &&
+           strcmp(lineScene, sceneName) == 0 && strcmp(linePreset, presetName) == 0) {
+            result = medianMicroseconds;
+            break;
+        }
+    }
+    
+    fclose(file);
+    
+    return result;
+}
+
+static void WriteBenchmarkResults(BenchmarkSettings* settings, BenchmarkResult* results, U32 resultCount) {
+    FILE* csvFile = fopen(BenchmarkCSVFile, "w");
+    if(csvFile) {
+        fprintf(csvFile, "scene,preset,width,height,repeats,median_us,min_us,max_us,rays,mrays_per_s,samples_per_s\n");
+        
+        for(U32 resultIndex = 0; resultIndex < resultCount; ++resultIndex) {
+            BenchmarkResult* result = results + resultIndex;
+            fprintf(csvFile, "%s,%s,%lu,%lu,%lu,%llu,%llu,%llu,%llu,%.3f,%.0f\n",
+                    result->sceneName, result->presetName,
+                    settings->imageWidth, settings->imageHeight, settings->repeatCount,
+                    result->medianMicroseconds, result->minMicroseconds, result->maxMicroseconds,
+                    result->rayCount, result->raysPerSecond / 1000000.0, result->samplesPerSecond);
+        }
+        
+        fclose(csvFile);
+    } else {
+        fprintf(stderr, "Not able to open %s for writing . . .", BenchmarkCSVFile);
+    }
+    
+    FILE* jsonFile = fopen(BenchmarkJSONFile, "w");
+    if(jsonFile) {
+        fprintf(jsonFile, "{\n");
+        fprintf(jsonFile, "  \"width\": %lu,\n  \"height\": %lu,\n", settings->imageWidth, settings->imageHeight);
+        fprintf(jsonFile, "  \"warmup\": %lu,\n  \"repeats\": %lu,\n  \"seed\": %lu,\n",
+                settings->warmupCount, settings->repeatCount, settings->seed);
+        fprintf(jsonFile, "  \"results\": [\n");
+        
+        for(U32 resultIndex = 0; resultIndex < resultCount; ++resultIndex) {
+            BenchmarkResult* result = results + resultIndex;
+            fprintf(jsonFile, "    {\"scene\": \"%s\", \"preset\": \"%s\", \"median_us\": %llu, \"min_us\": %llu, \"max_us\": %llu, "
+                    "\"rays\": %llu, \"mrays_per_s\": %.3f, \"samples_per_s\": %.0f}%s\n",
+                    result->sceneName, result->presetName,
+                    result->medianMicroseconds, result->minMicroseconds, result->maxMicroseconds,
+                    result->rayCount, result->raysPerSecond / 1000000.0, result->samplesPerSecond,
+                    resultIndex + 1 < resultCount ? "," : "");
+        }
+        
+        fprintf(jsonFile, "  ]\n}\n");
+        fclose(jsonFile);
+    } else {
+        fprintf(stderr, "Not able to open %s for writing . . .", BenchmarkJSONFile);
+    }
+}
+
+int main(int argumentCount, char** arguments) {
+    BenchmarkSettings settings;
+    if(!ParseBenchmarkArguments(argumentCount, arguments, &settings)) {
+        return 1;
+    }
+    
+    Options options[BENCHMARK_MAX_ENTRIES];
+    for(U32 presetIndex = 0; presetIndex < settings.presetCount; ++presetIndex) {
+        if(!GetOptionsPreset(settings.presetNames[presetIndex], options + presetIndex)) {
+            return 1;
+        }
+    }
+    
+    size_t pixelCount = (size_t)settings.imageWidth * (size_t)settings.imageHeight;
+    V3* hdrPixelData = (V3*)malloc(sizeof(V3) * pixelCount);
+    
+    RenderContext renderContext;
+    InitRenderContext(&renderContext);
+    
+    printf("Benchmark %lux%lu, %lu warmup and %lu timed runs per preset, seed %lu\n",
+           settings.imageWidth, settings.imageHeight,
+           settings.warmupCount, settings.repeatCount, settings.seed);
+    printf("%-20s %-12s %12s %10s %14s", "Scene", "Preset", "Median us", "Mrays/s", "Samples/s");
+    if(settings.baselineFileName) {
+        printf(" %10s", "Speedup");
+    }
+    printf("\n");
+    
+    BenchmarkResult results[BENCHMARK_MAX_ENTRIES * BENCHMARK_MAX_ENTRIES];
+    U32 resultCount = 0;
+    
+    //NOTE(ans): the default scene lives in static arrays, its bvh only gets built once
+    World defaultWorld;
+    V3 defaultCameraP;
+    bool defaultBuilt = false;
+    
+    for(U32 sceneIndex = 0; sceneIndex < settings.sceneCount; ++sceneIndex) {
+        char* sceneName = settings.sceneNames[sceneIndex];
+        
+        World world;
+        V3 cameraP;
+        
+        Scene scene = {};
+        if(strcmp(sceneName, "default") == 0) {
+            if(!defaultBuilt) {
+                BuildDefaultScene(&defaultWorld, &defaultCameraP);
+                defaultBuilt = true;
+            }
+            
+            world = defaultWorld;
+            cameraP = defaultCameraP;
+        } else {
+            if(!LoadScene(sceneName, &scene)) {
+                continue;
+            }
+            
+            world = scene.world;
+            cameraP = scene.cameraP;
+        }
+        
+        for(U32 presetIndex = 0; presetIndex < settings.presetCount; ++presetIndex) {
+            BenchmarkResult result = RunBenchmark(&renderContext, &settings,
+                                                  &world, cameraP, options + presetIndex, hdrPixelData);
+            result.sceneName = sceneName;
+            result.presetName = settings.presetNames[presetIndex];
+            
+            results[resultCount++] = result;
+            
+            printf("%-20s %-12s %12llu %10.2f %14.0f",
+                   result.sceneName, result.presetName, result.medianMicroseconds,
+                   result.raysPerSecond / 1000000.0, result.samplesPerSecond);
+            
+            if(settings.baselineFileName) {
+                U64 baselineMicroseconds = FindBaselineMicroseconds(settings.baselineFileName, sceneName, result.presetName);
+                if(baselineMicroseconds && result.medianMicroseconds) {
+                    printf(" %9.2fx", (double)baselineMicroseconds / (double)result.medianMicroseconds);
+                } else {
+                    printf(" %10s", "-");
+                }
+            }
+            printf("\n");
+        }
+        
+        FreeScene(&scene);
+    }
+    
+    WriteBenchmarkResults(&settings, results, resultCount);
+    
+    FreeRenderContext(&renderContext);
+    free(hdrPixelData);
+    
+    return 0;
+}
@@ -1,83 +1,106 @@
-static U8 LinearToRGB(F32 v) {
-    U8 result;
-    
-    if(v > 1.0f) {
-        v = 1;
-    }
-    
-    if(v < 0.0f) {
-        v = 0.0f;
-    }
+//NOTE(ans): v has to be in [0, 1]
+static F32 LinearToSRGB(F32 v) {
+    F32 result;
     
     if(v <= 0.0031308f) {
-        result = (U8)(v * 12.92f);
+        result = v * 12.92f;
     } else {
-        result = (U8)(1.055f * Pow(v, 1.0f / 2.4f) - 0.055f);
+        result = 1.055f * Pow(v, 1.0f / 2.4f) - 0.055f;
     }
     
     return result;
 }
 
-static inline F32 ClampColorComponent(F32 c) {
-    F32 result = c;
+//NOTE(ans): the table only changes with srgb, exposure and mode get applied in front of it
+static void BuildToneMap(ToneMap* toneMap, ToneMapMode mode, F32 exposure, U32 srgb) {
+    toneMap->mode = mode;
+    toneMap->exposure = exposure;
+    toneMap->srgb = srgb;
     
-    if(c > 1.0f) {
-        result = 1.0f;
-    }
-    else if(c < 0.0f) {
-        result = 0.0f;
+    for(U32 entryIndex = 0; entryIndex < TONE_MAP_TABLE_SIZE; ++entryIndex) {
+        F32 v = (F32)entryIndex / (F32)(TONE_MAP_TABLE_SIZE - 1);
+        if(srgb) {
+            v = LinearToSRGB(v);
+        }
+        
+        toneMap->table[entryIndex] = (U8)(v * 255.0f + 0.5f);
     }
-    
-    return result;
 }
 
-static inline V3 ClampColor(V3 color) {
-    V3 result;
-    
-    result.r = ClampColorComponent(color.r);
-    result.g = ClampColorComponent(color.g);
-    result.b = ClampColorComponent(color.b);
-    
-    return result;
-}
+//NOTE(ans): 
+// packs linear colors into bmp pixels, scale gets multiplied on top of the exposure.
+// the channels are handled as one flat float array, 8 at a time, only the table lookup is scalar
+#define TONE_MAP_CHUNK_PIXELS 64
 
-static U32 PackColor(V3 color) {
-    color = ClampColor(color);
+static void ToneMapPixels(ToneMap* toneMap, V3* hdrPixels, U32* packedPixels, size_t pixelCount, F32 scale) {
+    F32x8 exposure = SetF32x8(toneMap->exposure * scale);
+    F32x8 zero = SetF32x8(0.0f);
+    F32x8 one = SetF32x8(1.0f);
+    F32x8 tableScale = SetF32x8((F32)(TONE_MAP_TABLE_SIZE - 1));
+    F32x8 half = SetF32x8(0.5f);
+    bool reinhard = toneMap->mode == ToneMapMode_Reinhard;
     
-    U8 r = (U8)(color.r * 255);
-    U8 g = (U8)(color.g * 255);
-    U8 b = (U8)(color.b * 255);
+    U32 indices[TONE_MAP_CHUNK_PIXELS * 3 + LANE_WIDTH];
     
-    
-    U32 result = 0;
-    
-    //alpa
-    result |= 255 << 24;
-    
-    //red
-    result |= r << 16;
-    
-    //green
-    result |= g << 8;
-    
-    //blue
-    result |= b;
-    
-    return result;
+    for(size_t firstPixel = 0; firstPixel < pixelCount; firstPixel += TONE_MAP_CHUNK_PIXELS) {
+        size_t chunkPixels = pixelCount - firstPixel;
+        if(chunkPixels > TONE_MAP_CHUNK_PIXELS) {
+            chunkPixels = TONE_MAP_CHUNK_PIXELS;
+        }
+        
+        F32* values = (F32*)(hdrPixels + firstPixel);
+        U32 valueCount = (U32)chunkPixels * 3;
+        
+        //NOTE(ans): the last lanes of the image get padded with zeros
+        F32 tail[LANE_WIDTH];
+        for(U32 valueIndex = 0; valueIndex < valueCount; valueIndex += LANE_WIDTH) {
+            F32* laneValues = values + valueIndex;
+            if(valueIndex + LANE_WIDTH > valueCount) {
+                for(U32 lane = 0; lane < LANE_WIDTH; ++lane) {
+                    tail[lane] = valueIndex + lane < valueCount ? laneValues[lane] : 0.0f;
+                }
+                laneValues = tail;
+            }
+            
+            F32x8 v = LoadF32x8(laneValues) * exposure;
+            if(reinhard) {
+                v = v / (one + Max(v, zero));
+            }
+            v = Min(Max(v, zero), one);
+            
+            StoreTruncatedU32x8(indices + valueIndex, v * tableScale + half);
+        }
+        
+        for(U32 pixelIndex = 0; pixelIndex < chunkPixels; ++pixelIndex) {
+            U32* pixelIndices = indices + pixelIndex * 3;
+            
+            U32 packed = 0xFF000000;
+            packed |= (U32)toneMap->table[pixelIndices[0]] << 16;
+            packed |= (U32)toneMap->table[pixelIndices[1]] << 8;
+            packed |= (U32)toneMap->table[pixelIndices[2]];
+            
+            packedPixels[firstPixel + pixelIndex] = packed;
+        }
+    }
 }
 
-static void InitBMPImage(BMP_Image* image, U32 width, U32 height) {
-    U32 pixelCount = width * height;
-    U32 pixelDataSize = pixelCount * sizeof(U32);
+//NOTE(ans): 
+// the size fields are only 32 bit, images with more than 4gb of pixels get 0 there.
+// sizeImage 0 is valid for uncompressed images and readers take the pixel data size from width and height
+static BMP_Header CreateBMPHeader(U32 width, U32 height) {
+    U64 pixelDataSize = (U64)width * (U64)height * sizeof(U32);
+    U64 fileSize = pixelDataSize + sizeof(BMP_FileHeader) + sizeof(BMP_ImageHeader);
+    
+    BMP_Header header;
     
     BMP_FileHeader fileHeader = {};
     fileHeader.type1 = 'B';
     fileHeader.type2 = 'M';
-    fileHeader.size = pixelDataSize + sizeof(BMP_FileHeader) + sizeof(BMP_ImageHeader);
+    fileHeader.size = fileSize > U32_MAX ? 0 : (U32)fileSize;
     fileHeader.reserved1 = 0;
     fileHeader.reserved2 = 0;
     fileHeader.offBits = sizeof(BMP_FileHeader) + sizeof(BMP_ImageHeader);
-    image->header.fileHeader = fileHeader;
+    header.fileHeader = fileHeader;
     
     BMP_ImageHeader imageHeader = {};
     imageHeader.size = sizeof(BMP_ImageHeader);
@@ -86,19 +109,26 @@ static void InitBMPImage(BMP_Image* image, U32 width, U32 height) {
     imageHeader.planes = 1;
     imageHeader.bitCount = 32;
     imageHeader.compression = 0;
-    imageHeader.sizeImage = pixelDataSize;
+    imageHeader.sizeImage = fileSize > U32_MAX ? 0 : (U32)pixelDataSize;
     imageHeader.xPelsPerMeter = 0;
     imageHeader.yPelsPerMeter = 0;
     imageHeader.clrUsed = 0;
     imageHeader.clrImportant = 0;
-    image->header.imageHeader = imageHeader;
+    header.imageHeader = imageHeader;
+    
+    return header;
+}
+
+static void InitBMPImage(BMP_Image* image, U32 width, U32 height) {
+    image->header = CreateBMPHeader(width, height);
     
+    size_t pixelDataSize = (size_t)width * (size_t)height * sizeof(U32);
     U32* pixelData = (U32*)malloc(pixelDataSize);
     image->pixelData = pixelData;
 }
 
-static U32 GetPixelCount(BMP_Image* image) {
-    return image->header.imageHeader.width * image->header.imageHeader.height;
+static U64 GetPixelCount(BMP_Image* image) {
+    return (U64)image->header.imageHeader.width * (U64)image->header.imageHeader.height;
 }
 
 static void WriteBMPImage(BMP_Image* image, char* fileName) {
@@ -115,13 +145,169 @@ static void WriteBMPImage(BMP_Image* image, char* fileName) {
            file);
     
     fwrite((void*)image->pixelData,
-           image->header.imageHeader.sizeImage,
-           1,
+           sizeof(U32),
+           (size_t)GetPixelCount(image),
            file);
     
     fclose(file);
 }
 
+static bool BeginImageStream(ImageStream* stream, char* fileName, U32 width, U32 height) {
+    FILE* file = fopen(fileName, "wb");
+    if(!file) {
+        fprintf(stderr, "Not able to open result file for writing . . .");
+        
+        return false;
+    }
+    
+    stream->file = file;
+    stream->width = width;
+    stream->height = height;
+    stream->rowsWritten = 0;
+    
+    return true;
+}
+
+static void WriteImageStreamRows(ImageStream* stream, void* rows, size_t bytesPerPixel, U32 rowCount) {
+    size_t pixelCount = (size_t)stream->width * (size_t)rowCount;
+    size_t written = fwrite(rows,
+                            bytesPerPixel,
+                            pixelCount,
+                            stream->file);
+    
+    if(written != pixelCount) {
+        fprintf(stderr, "Not able to write rows to the result file . . .");
+    }
+    
+    stream->rowsWritten += rowCount;
+}
+
+static void EndImageStream(ImageStream* stream) {
+    if(stream->rowsWritten != stream->height) {
+        fprintf(stderr, "Result file is missing %lu rows . . .", stream->height - stream->rowsWritten);
+    }
+    
+    fclose(stream->file);
+    stream->file = 0;
+}
+
+//NOTE(ans): 
+// writes the header up front and the pixel rows as they come in, bottom row first like the image in memory.
+// the whole image never has to fit into memory
+static bool BeginBMPStream(ImageStream* stream, char* fileName, U32 width, U32 height) {
+    if(!BeginImageStream(stream, fileName, width, height)) {
+        return false;
+    }
+    
+    BMP_Header header = CreateBMPHeader(width, height);
+    fwrite((void*)&header,
+           sizeof(BMP_Header),
+           1,
+           stream->file);
+    
+    return true;
+}
+
+static void WriteBMPStreamRows(ImageStream* stream, U32* pixelData, U32 rowCount) {
+    WriteImageStreamRows(stream, (void*)pixelData, sizeof(U32), rowCount);
+}
+
+//NOTE(ans): 
+// portable float map with linear rgb for compositing, -1 marks little endian.
+// pfm rows go bottom to top as well, so they get streamed the same way
+static bool BeginPFMStream(ImageStream* stream, char* fileName, U32 width, U32 height) {
+    if(!BeginImageStream(stream, fileName, width, height)) {
+        return false;
+    }
+    
+    fprintf(stream->file, "PF\n%lu %lu\n-1\n", width, height);
+    
+    return true;
+}
+
+static void WritePFMStreamRows(ImageStream* stream, V3* pixelData, U32 rowCount) {
+    WriteImageStreamRows(stream, (void*)pixelData, sizeof(V3), rowCount);
+}
+
+static void WritePFMImage(V3* pixelData, U32 width, U32 height, char* fileName) {
+    ImageStream stream;
+    if(!BeginPFMStream(&stream, fileName, width, height)) {
+        return;
+    }
+    
+    WritePFMStreamRows(&stream, pixelData, height);
+    EndImageStream(&stream);
+}
+
+#define COST_HISTOGRAM_SIZE 1024
+
+//NOTE(ans): black, blue, red, yellow, white from cheap to expensive
+static U32 CostColor(F32 v) {
+    static F32 stops[5][3] = {
+        {0, 0, 0},
+        {0, 0, 1},
+        {1, 0, 0},
+        {1, 1, 0},
+        {1, 1, 1}
+    };
+    
+    F32 position = Min(Max(v, 0.0f), 1.0f) * 4.0f;
+    U32 stopIndex = (U32)position;
+    if(stopIndex > 3) {
+        stopIndex = 3;
+    }
+    F32 t = position - (F32)stopIndex;
+    
+    U32 result = 0xFF000000;
+    for(U32 channel = 0; channel < 3; ++channel) {
+        F32 value = stops[stopIndex][channel] + (stops[stopIndex + 1][channel] - stops[stopIndex][channel]) * t;
+        result |= (U32)(value * 255.0f + 0.5f) << (16 - channel * 8);
+    }
+    
+    return result;
+}
+
+//NOTE(ans): 
+// writes the cost of every pixel as a heatmap. a few pixels get interrupted by the os and take
+// far longer than the rest, so white is the 99.5th percentile instead of the most expensive pixel
+static void WriteCostImage(F32* pixelCosts, U32 width, U32 height, char* fileName) {
+    U64 pixelCount = (U64)width * (U64)height;
+    
+    F32 maxCost = 0;
+    for(U64 pixelIndex = 0; pixelIndex < pixelCount; ++pixelIndex) {
+        maxCost = Max(maxCost, pixelCosts[pixelIndex]);
+    }
+    
+    U64 histogram[COST_HISTOGRAM_SIZE] = {};
+    F32 histogramScale = maxCost > 0 ? (F32)(COST_HISTOGRAM_SIZE - 1) / maxCost : 0;
+    for(U64 pixelIndex = 0; pixelIndex < pixelCount; ++pixelIndex) {
+        ++histogram[(U32)(pixelCosts[pixelIndex] * histogramScale)];
+    }
+    
+    U64 percentileCount = pixelCount - pixelCount / 200;
+    U64 count = 0;
+    U32 binIndex = 0;
+    for(; binIndex < COST_HISTOGRAM_SIZE - 1; ++binIndex) {
+        count += histogram[binIndex];
+        if(count >= percentileCount) {
+            break;
+        }
+    }
+    
+    F32 whiteCost = maxCost * (F32)(binIndex + 1) / (F32)COST_HISTOGRAM_SIZE;
+    F32 costScale = whiteCost > 0 ? 1.0f / whiteCost : 0;
+    
+    BMP_Image image;
+    InitBMPImage(&image, width, height);
+    
+    for(U64 pixelIndex = 0; pixelIndex < pixelCount; ++pixelIndex) {
+        image.pixelData[pixelIndex] = CostColor(pixelCosts[pixelIndex] * costScale);
+    }
+    
+    WriteBMPImage(&image, fileName);
+    free(image.pixelData);
+}
+
 static void GetDimensions(BMP_Image* image,
                           U32* height,
                           U32* width) {
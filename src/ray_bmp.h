@@ -33,3 +33,28 @@ struct BMP_Image {
     BMP_Header header;
     U32* pixelData;
 };
+
+//NOTE(ans): rows of a bmp or pfm file written as they get finished, bottom row first
+struct ImageStream {
+    FILE* file;
+    U32 width;
+    U32 height;
+    U32 rowsWritten;
+};
+
+enum ToneMapMode {
+    ToneMapMode_Clamp,
+    ToneMapMode_Reinhard
+};
+
+//NOTE(ans): enough entries that neighbours are less than one 8 bit step apart after the srgb curve
+#define TONE_MAP_TABLE_SIZE 4096
+
+//NOTE(ans): maps linear colors from [0, 1] after the curve to 8 bit, srgb encoded or not
+struct ToneMap {
+    ToneMapMode mode;
+    F32 exposure;
+    U32 srgb;
+    
+    U8 table[TONE_MAP_TABLE_SIZE];
+};
@@ -0,0 +1,337 @@
+static inline AABB EmptyAABB() {
+    AABB result;
+    
+    result.min = {F32_MAX, F32_MAX, F32_MAX};
+    result.max = {-F32_MAX, -F32_MAX, -F32_MAX};
+    
+    return result;
+}
+
+static inline void GrowAABB(AABB* bounds, AABB other) {
+    bounds->min = Min(bounds->min, other.min);
+    bounds->max = Max(bounds->max, other.max);
+}
+
+static inline void GrowAABB(AABB* bounds, V3 point) {
+    bounds->min = Min(bounds->min, point);
+    bounds->max = Max(bounds->max, point);
+}
+
+static inline F32 SurfaceArea(AABB bounds) {
+    F32 result;
+    
+    V3 extent = bounds.max - bounds.min;
+    result = 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    
+    return result;
+}
+
+static inline AABB SphereBounds(Sphere sphere) {
+    AABB result;
+    
+    result.min = sphere.p - sphere.r;
+    result.max = sphere.p + sphere.r;
+    
+    return result;
+}
+
+static inline F32 GetAxis(V3 v, U32 axis) {
+    F32 result;
+    
+    if(axis == 0) {
+        result = v.x;
+    } else if(axis == 1) {
+        result = v.y;
+    } else {
+        result = v.z;
+    }
+    
+    return result;
+}
+
+static inline V3 InverseDirection(V3 direction) {
+    //NOTE(ans): avoid 0 * inf = nan in the slab test for axis aligned rays
+    F32 lowerBound = 1e-20f;
+    F32 x = (direction.x < lowerBound && direction.x > -lowerBound) ? lowerBound : direction.x;
+    F32 y = (direction.y < lowerBound && direction.y > -lowerBound) ? lowerBound : direction.y;
+    F32 z = (direction.z < lowerBound && direction.z > -lowerBound) ? lowerBound : direction.z;
+    
+    V3 result = {1.0f / x, 1.0f / y, 1.0f / z};
+    
+    return result;
+}
+
+//NOTE(ans): slab test, returns the entry distance or F32_MAX when the box is missed
+static inline F32 IntersectAABB(AABB bounds,
+                                V3 rayOrigin, V3 inverseDirection,
+                                F32 maxDistance) {
+    F32 t1x = (bounds.min.x - rayOrigin.x) * inverseDirection.x;
+    F32 t2x = (bounds.max.x - rayOrigin.x) * inverseDirection.x;
+    F32 t1y = (bounds.min.y - rayOrigin.y) * inverseDirection.y;
+    F32 t2y = (bounds.max.y - rayOrigin.y) * inverseDirection.y;
+    F32 t1z = (bounds.min.z - rayOrigin.z) * inverseDirection.z;
+    F32 t2z = (bounds.max.z - rayOrigin.z) * inverseDirection.z;
+    
+    F32 tEnter = Max(Max(Min(t1x, t2x), Min(t1y, t2y)), Min(t1z, t2z));
+    F32 tExit = Min(Min(Max(t1x, t2x), Max(t1y, t2y)), Max(t1z, t2z));
+    
+    F32 result = F32_MAX;
+    if(tExit >= tEnter && tExit > 0 && tEnter < maxDistance) {
+        result = tEnter;
+    }
+    
+    return result;
+}
+
+struct BVHBin {
+    AABB bounds;
+    U32 count;
+};
+
+struct BVHBuilder {
+    BVHNode* nodes;
+    U32 nodeCount;
+    
+    Sphere* spheres;
+    V3* centroids;
+};
+
+static inline void SwapSpheres(BVHBuilder* builder, U32 a, U32 b) {
+    Sphere sphere = builder->spheres[a];
+    builder->spheres[a] = builder->spheres[b];
+    builder->spheres[b] = sphere;
+    
+    V3 centroid = builder->centroids[a];
+    builder->centroids[a] = builder->centroids[b];
+    builder->centroids[b] = centroid;
+}
+
+static void SubdivideBVHNode(BVHBuilder* builder, U32 nodeIndex, U32 depth) {
+    BVHNode* node = builder->nodes + nodeIndex;
+    U32 first = node->firstIndex;
+    U32 count = node->count;
+    
+    AABB bounds = EmptyAABB();
+    AABB centroidBounds = EmptyAABB();
+    for(U32 sphereIndex = first; sphereIndex < first + count; ++sphereIndex) {
+        GrowAABB(&bounds, SphereBounds(builder->spheres[sphereIndex]));
+        GrowAABB(&centroidBounds, builder->centroids[sphereIndex]);
+    }
+    node->bounds = bounds;
+    
+    if(count <= BVH_MAX_LEAF_SIZE || depth >= BVH_MAX_DEPTH - 1) {
+        return;
+    }
+    
+    //NOTE(ans):
+    // binned SAH, every axis gets BVH_BIN_COUNT bins over the centroid bounds and the
+    // split plane between two bins with the lowest area * count on both sides wins
+    F32 bestCost = F32_MAX;
+    U32 bestAxis = 0;
+    U32 bestSplit = 0;
+    
+    for(U32 axis = 0; axis < 3; ++axis) {
+        F32 axisMin = GetAxis(centroidBounds.min, axis);
+        F32 axisExtent = GetAxis(centroidBounds.max, axis) - axisMin;
+        if(axisExtent <= 0) {
+            continue;
+        }
+    
+        BVHBin bins[BVH_BIN_COUNT];
+        for(U32 binIndex = 0; binIndex < BVH_BIN_COUNT; ++binIndex) {
+            bins[binIndex].bounds = EmptyAABB();
+            bins[binIndex].count = 0;
+        }
+    
+        F32 binScale = BVH_BIN_COUNT / axisExtent;
+        for(U32 sphereIndex = first; sphereIndex < first + count; ++sphereIndex) {
+            F32 c = GetAxis(builder->centroids[sphereIndex], axis);
+            U32 binIndex = (U32)((c - axisMin) * binScale);
+            if(binIndex >= BVH_BIN_COUNT) {
+                binIndex = BVH_BIN_COUNT - 1;
+            }
+    
+            bins[binIndex].count++;
+            GrowAABB(&bins[binIndex].bounds, SphereBounds(builder->spheres[sphereIndex]));
+        }
+    
+        F32 leftAreas[BVH_BIN_COUNT - 1];
+        U32 leftCounts[BVH_BIN_COUNT - 1];
+        AABB leftBounds = EmptyAABB();
+        U32 leftCount = 0;
+        for(U32 split = 0; split < BVH_BIN_COUNT - 1; ++split) {
+            leftCount += bins[split].count;
+            if(bins[split].count) {
+                GrowAABB(&leftBounds, bins[split].bounds);
+            }
+    
+            leftCounts[split] = leftCount;
+            leftAreas[split] = leftCount ? SurfaceArea(leftBounds) : 0;
+        }
+    
+        AABB rightBounds = EmptyAABB();
+        U32 rightCount = 0;
+        for(U32 split = BVH_BIN_COUNT - 1; split > 0; --split) {
+            rightCount += bins[split].count;
+            if(bins[split].count) {
+                GrowAABB(&rightBounds, bins[split].bounds);
+            }
+    
+            if(!rightCount || !leftCounts[split - 1]) {
+                continue;
+            }
+    
+            F32 cost = leftCounts[split - 1] * leftAreas[split - 1] + rightCount * SurfaceArea(rightBounds);
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+    
+    U32 leftCount = 0;
+    if(bestCost < F32_MAX) {
+        //NOTE(ans): 
+        // spheres get tested LANE_WIDTH at a time, a traversal step costs about as much
+        // as one of those tests
+        F32 leafCost = (F32)((count + LANE_WIDTH - 1) / LANE_WIDTH);
+        F32 splitCost = 1.0f + bestCost / (SurfaceArea(bounds) * LANE_WIDTH);
+        if(splitCost >= leafCost && count <= BVH_MAX_SAH_LEAF_SIZE) {
+            return;
+        }
+    
+        F32 axisMin = GetAxis(centroidBounds.min, bestAxis);
+        F32 binScale = BVH_BIN_COUNT / (GetAxis(centroidBounds.max, bestAxis) - axisMin);
+    
+        U32 left = first;
+        U32 right = first + count;
+        while(left < right) {
+            F32 c = GetAxis(builder->centroids[left], bestAxis);
+            U32 binIndex = (U32)((c - axisMin) * binScale);
+            if(binIndex >= BVH_BIN_COUNT) {
+                binIndex = BVH_BIN_COUNT - 1;
+            }
+    
+            if(binIndex < bestSplit) {
+                ++left;
+            } else {
+                --right;
+                SwapSpheres(builder, left, right);
+            }
+        }
+    
+        leftCount = left - first;
+    }
+    
+    //NOTE(ans): all centroids in one spot, split in the middle so leaves stay small
+    if(leftCount == 0 || leftCount == count) {
+        leftCount = count / 2;
+    }
+    
+    U32 leftIndex = builder->nodeCount;
+    builder->nodeCount += 2;
+    
+    BVHNode* leftNode = builder->nodes + leftIndex;
+    leftNode->firstIndex = first;
+    leftNode->count = leftCount;
+    
+    BVHNode* rightNode = builder->nodes + leftIndex + 1;
+    rightNode->firstIndex = first + leftCount;
+    rightNode->count = count - leftCount;
+    
+    node->firstIndex = leftIndex;
+    node->count = 0;
+    
+    SubdivideBVHNode(builder, leftIndex, depth + 1);
+    SubdivideBVHNode(builder, leftIndex + 1, depth + 1);
+}
+
+//NOTE(ans): reorders world->spheres so that every leaf covers a contiguous range
+static void BuildSphereBVH(World* world) {
+    U32 sphereCount = world->sphereCount;
+    
+    world->sphereNodes = 0;
+    world->sphereNodeCount = 0;
+    
+    if(sphereCount == 0) {
+        return;
+    }
+    
+    BVHBuilder builder;
+    builder.nodes = (BVHNode*)malloc(sizeof(BVHNode) * (2 * sphereCount - 1));
+    builder.nodeCount = 1;
+    builder.spheres = world->spheres;
+    builder.centroids = (V3*)malloc(sizeof(V3) * sphereCount);
+    
+    for(U32 sphereIndex = 0; sphereIndex < sphereCount; ++sphereIndex) {
+        builder.centroids[sphereIndex] = world->spheres[sphereIndex].p;
+    }
+    
+    BVHNode* root = builder.nodes;
+    root->firstIndex = 0;
+    root->count = sphereCount;
+    
+    SubdivideBVHNode(&builder, 0, 0);
+    
+    free(builder.centroids);
+    
+    world->sphereNodes = builder.nodes;
+    world->sphereNodeCount = builder.nodeCount;
+}
+
+static F32* AllocateLanes(U32 count) {
+    U32 paddedCount = count + LANE_WIDTH;
+    F32* result = (F32*)malloc(sizeof(F32) * paddedCount);
+    
+    for(U32 index = 0; index < paddedCount; ++index) {
+        result[index] = 0;
+    }
+    
+    return result;
+}
+
+static void BuildGeometryLanes(World* world) {
+    U32 sphereCount = world->sphereCount;
+    SphereLanes sphereLanes;
+    sphereLanes.x = AllocateLanes(sphereCount);
+    sphereLanes.y = AllocateLanes(sphereCount);
+    sphereLanes.z = AllocateLanes(sphereCount);
+    sphereLanes.radiusSquared = AllocateLanes(sphereCount);
+    
+    for(U32 sphereIndex = 0; sphereIndex < sphereCount; ++sphereIndex) {
+        Sphere sphere = world->spheres[sphereIndex];
+        
+        sphereLanes.x[sphereIndex] = sphere.p.x;
+        sphereLanes.y[sphereIndex] = sphere.p.y;
+        sphereLanes.z[sphereIndex] = sphere.p.z;
+        sphereLanes.radiusSquared[sphereIndex] = sphere.r * sphere.r;
+    }
+    
+    //NOTE(ans): padding planes keep a zero normal, which the kernel rejects as parallel
+    U32 planeCount = world->planeCount;
+    PlaneLanes planeLanes;
+    planeLanes.nx = AllocateLanes(planeCount);
+    planeLanes.ny = AllocateLanes(planeCount);
+    planeLanes.nz = AllocateLanes(planeCount);
+    planeLanes.d = AllocateLanes(planeCount);
+    
+    for(U32 planeIndex = 0; planeIndex < planeCount; ++planeIndex) {
+        Plane plane = world->planes[planeIndex];
+        
+        planeLanes.nx[planeIndex] = plane.n.x;
+        planeLanes.ny[planeIndex] = plane.n.y;
+        planeLanes.nz[planeIndex] = plane.n.z;
+        planeLanes.d[planeIndex] = Inner(plane.p, plane.n);
+    }
+    
+    world->sphereLanes = sphereLanes;
+    world->planeLanes = planeLanes;
+}
+
+static void BuildWorldAcceleration(World* world) {
+    BuildSphereBVH(world);
+    
+    //NOTE(ans): after the bvh, it reorders the spheres
+    BuildGeometryLanes(world);
+}
@@ -0,0 +1,24 @@
+struct AABB {
+    V3 min;
+    V3 max;
+};
+
+//NOTE(ans):
+// nodes are stored in one flat array and reference each other by index so the tree
+// can be copied or written to disk as is.
+// inner node: firstIndex is the left child, the right child directly follows it
+// leaf node:  firstIndex is the first sphere, the spheres of a leaf are contiguous
+struct BVHNode {
+    AABB bounds;
+    U32 firstIndex;
+    U32 count;
+};
+
+//NOTE(ans): 
+// leaves are tested LANE_WIDTH spheres at a time. the size limits are multiples of LANE_WIDTH but
+// a leaf can hold any count up to them, the last load of a leaf masks off the lanes past its end
+// and the padding of the sphere lanes keeps that load inside the arrays
+#define BVH_MAX_LEAF_SIZE LANE_WIDTH
+#define BVH_MAX_SAH_LEAF_SIZE (2 * LANE_WIDTH)
+#define BVH_BIN_COUNT 16
+#define BVH_MAX_DEPTH 64
@@ -0,0 +1,482 @@
+//NOTE(ans): enough bands that dropping a worker only costs a small part of the image
+#define DISTRIBUTED_BAND_TILE_ROWS 2
+#define DISTRIBUTED_POLL_MILLISECONDS 100
+#define DISTRIBUTED_CONNECT_ATTEMPTS 30
+
+//NOTE(ans): a worker that stops sending in the middle of a result gets dropped after this long
+#define DISTRIBUTED_RECEIVE_TIMEOUT_MILLISECONDS 10000
+
+//NOTE(ans):
+// a band that runs this many times longer than the average band gets handed to an idle worker
+// as well, whichever result comes first is used. catches workers that hang without disconnecting
+#define DISTRIBUTED_OVERTAKE_FACTOR 4
+#define DISTRIBUTED_OVERTAKE_MIN_MICROSECONDS 2000000
+
+static bool SendDistributedMessage(NetSocket netSocket, DistributedMessageType type,
+                                   void* payload, U64 payloadSize,
+                                   void* extra, U64 extraSize) {
+    DistributedMessageHeader header = {};
+    header.type = type;
+    header.payloadSize = payloadSize + extraSize;
+    
+    bool result = SendAll(netSocket, &header, sizeof(header)) &&
+        SendAll(netSocket, payload, (size_t)payloadSize) &&
+        SendAll(netSocket, extra, (size_t)extraSize);
+    
+    return result;
+}
+
+static bool ReceiveDistributedHeader(NetSocket netSocket, DistributedMessageType type, U64 payloadSize) {
+    DistributedMessageHeader header;
+    if(!ReceiveAll(netSocket, &header, sizeof(header))) {
+        return false;
+    }
+    
+    bool result = header.type == (U32)type && header.payloadSize == payloadSize;
+    
+    return result;
+}
+
+static void DropWorker(DistributedWorker* worker, U32 workerIndex, DistributedBandSlot* slots) {
+    CloseNetSocket(worker->socket);
+    worker->alive = false;
+    
+    if(worker->bandIndex != U32_MAX) {
+        DistributedBandSlot* slot = slots + worker->bandIndex;
+        --slot->runningCount;
+        
+        if(slot->state == DistributedBandState_Running && slot->runningCount == 0) {
+            slot->state = DistributedBandState_Pending;
+        }
+        
+        printf("\nWorker %lu lost, band %lu goes back to the queue\n", workerIndex, worker->bandIndex);
+        worker->bandIndex = U32_MAX;
+    } else {
+        printf("\nWorker %lu lost\n", workerIndex);
+    }
+}
+
+//NOTE(ans): pending bands first, after that the band that is overdue for the longest time or U32_MAX
+static U32 PickBand(DistributedBandSlot* slots, U32 bandCount, U64 averageBandMicroseconds, U64 now) {
+    for(U32 bandIndex = 0; bandIndex < bandCount; ++bandIndex) {
+        if(slots[bandIndex].state == DistributedBandState_Pending) {
+            return bandIndex;
+        }
+    }
+    
+    if(!averageBandMicroseconds) {
+        return U32_MAX;
+    }
+    
+    U64 overdueMicroseconds = averageBandMicroseconds * DISTRIBUTED_OVERTAKE_FACTOR;
+    if(overdueMicroseconds < DISTRIBUTED_OVERTAKE_MIN_MICROSECONDS) {
+        overdueMicroseconds = DISTRIBUTED_OVERTAKE_MIN_MICROSECONDS;
+    }
+    
+    U32 result = U32_MAX;
+    U64 oldestStart = now;
+    for(U32 bandIndex = 0; bandIndex < bandCount; ++bandIndex) {
+        DistributedBandSlot* slot = slots + bandIndex;
+        
+        if(slot->state == DistributedBandState_Running &&
+           slot->runningCount == 1 &&
+           now - slot->startTimeStamp > overdueMicroseconds &&
+           slot->startTimeStamp < oldestStart) {
+            oldestStart = slot->startTimeStamp;
+            result = bandIndex;
+        }
+    }
+    
+    return result;
+}
+
+//NOTE(ans):
+// hands out the bands of the image to every worker that connects on port and assembles their results,
+// workers can join and leave at any time. writes the same files as a local render
+static bool RunCoordinator(U32 port, char* sceneFileName, Options* options, U32 imageWidth, U32 imageHeight) {
+    DistributedJob job = {};
+    job.magic = DISTRIBUTED_MAGIC;
+    job.version = DISTRIBUTED_VERSION;
+    job.optionsSize = sizeof(Options);
+    job.pixelSize = sizeof(V3);
+    job.imageWidth = imageWidth;
+    job.imageHeight = imageHeight;
+    job.options = *options;
+    
+    //NOTE(ans): bands are rendered in one pass straight into memory
+    job.options.progressivePasses = 0;
+    job.options.streamOutput = 0;
+    job.options.saveCostImage = 0;
+    
+    if(sceneFileName) {
+        if(strlen(sceneFileName) >= DISTRIBUTED_SCENE_NAME_SIZE) {
+            fprintf(stderr, "Scene file name %s is too long . . .", sceneFileName);
+            return false;
+        }
+        strcpy(job.sceneFileName, sceneFileName);
+    }
+    
+    if(!InitNetwork()) {
+        return false;
+    }
+    
+    NetSocket listenSocket = ListenTCP(port);
+    if(listenSocket == NET_INVALID_SOCKET) {
+        fprintf(stderr, "Not able to listen on port %lu . . .", port);
+        FreeNetwork();
+        return false;
+    }
+    
+    U32 bandHeight = options->tileSize * DISTRIBUTED_BAND_TILE_ROWS;
+    U32 bandCount = (imageHeight + bandHeight - 1) / bandHeight;
+    
+    DistributedBandSlot* slots = (DistributedBandSlot*)malloc(sizeof(DistributedBandSlot) * bandCount);
+    for(U32 bandIndex = 0; bandIndex < bandCount; ++bandIndex) {
+        DistributedBandSlot* slot = slots + bandIndex;
+        *slot = {};
+        slot->band.bandIndex = bandIndex;
+        slot->band.y = bandIndex * bandHeight;
+        slot->band.rowCount = imageHeight - slot->band.y < bandHeight ? imageHeight - slot->band.y : bandHeight;
+        slot->state = DistributedBandState_Pending;
+    }
+    
+    size_t pixelCount = (size_t)imageWidth * (size_t)imageHeight;
+    V3* hdrPixelData = (V3*)malloc(sizeof(V3) * pixelCount);
+    
+    //NOTE(ans): results of bands that another worker finished first end up here
+    V3* discardRows = (V3*)malloc(sizeof(V3) * (size_t)imageWidth * (size_t)bandHeight);
+    
+    DistributedWorker workers[DISTRIBUTED_MAX_WORKERS];
+    U32 workerCount = 0;
+    
+    RayTraceStats stats = {};
+    U32 doneCount = 0;
+    U32 printedDoneCount = U32_MAX;
+    U64 bandMicrosecondsSum = 0;
+    
+    printf("Waiting for workers on port %lu . . .\n", port);
+    
+    U64 startTimeStamp = GetTimeStamp();
+    while(doneCount < bandCount) {
+        NetSocket sockets[DISTRIBUTED_MAX_WORKERS + 1];
+        U32 socketWorkers[DISTRIBUTED_MAX_WORKERS + 1];
+        bool readable[DISTRIBUTED_MAX_WORKERS + 1];
+        
+        sockets[0] = listenSocket;
+        U32 socketCount = 1;
+        for(U32 workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+            if(workers[workerIndex].alive) {
+                sockets[socketCount] = workers[workerIndex].socket;
+                socketWorkers[socketCount] = workerIndex;
+                ++socketCount;
+            }
+        }
+        
+        WaitForSockets(sockets, socketCount, readable, DISTRIBUTED_POLL_MILLISECONDS);
+        
+        if(readable[0]) {
+            NetSocket workerSocket = AcceptTCP(listenSocket);
+            
+            if(workerSocket != NET_INVALID_SOCKET) {
+                //NOTE(ans): slots of lost workers get reused, so workers can reconnect as often as they like
+                U32 workerIndex = 0;
+                while(workerIndex < workerCount && workers[workerIndex].alive) {
+                    ++workerIndex;
+                }
+                
+                SetReceiveTimeout(workerSocket, DISTRIBUTED_RECEIVE_TIMEOUT_MILLISECONDS);
+                
+                if(workerIndex < DISTRIBUTED_MAX_WORKERS &&
+                   SendDistributedMessage(workerSocket, DistributedMessage_Job, &job, sizeof(job), 0, 0)) {
+                    if(workerIndex == workerCount) {
+                        ++workerCount;
+                    }
+                    
+                    DistributedWorker* worker = workers + workerIndex;
+                    worker->socket = workerSocket;
+                    worker->alive = true;
+                    worker->bandIndex = U32_MAX;
+                    worker->bandsDone = 0;
+                    
+                    printf("\nWorker %lu connected\n", workerIndex);
+                } else {
+                    CloseNetSocket(workerSocket);
+                }
+            }
+        }
+        
+        for(U32 socketIndex = 1; socketIndex < socketCount; ++socketIndex) {
+            if(!readable[socketIndex]) {
+                continue;
+            }
+            
+            U32 workerIndex = socketWorkers[socketIndex];
+            DistributedWorker* worker = workers + workerIndex;
+            
+            //NOTE(ans):
+            // workers only talk after a band request, anything else means the worker is gone or broken.
+            // a result that stops arriving halfway runs into the receive timeout and drops the worker as well
+            DistributedBandResult bandResult;
+            bool received = false;
+            if(worker->bandIndex != U32_MAX) {
+                DistributedBand band = slots[worker->bandIndex].band;
+                U64 rowsSize = sizeof(V3) * (U64)imageWidth * (U64)band.rowCount;
+                
+                received = ReceiveDistributedHeader(worker->socket, DistributedMessage_BandResult,
+                                                    sizeof(DistributedBandResult) + rowsSize) &&
+                    ReceiveAll(worker->socket, &bandResult, sizeof(bandResult)) &&
+                    bandResult.band.bandIndex == band.bandIndex;
+                
+                if(received) {
+                    DistributedBandSlot* slot = slots + band.bandIndex;
+                    bool firstResult = slot->state != DistributedBandState_Done;
+                    
+                    V3* rows = firstResult ? hdrPixelData + (size_t)band.y * imageWidth : discardRows;
+                    received = ReceiveAll(worker->socket, rows, (size_t)rowsSize);
+                    
+                    if(received) {
+                        --slot->runningCount;
+                        worker->bandIndex = U32_MAX;
+                        
+                        if(firstResult) {
+                            slot->state = DistributedBandState_Done;
+                            ++doneCount;
+                            ++worker->bandsDone;
+                            bandMicrosecondsSum += GetTimeStamp() - slot->startTimeStamp;
+                            
+                            AddRayTraceStats(&stats, bandResult.stats);
+                        }
+                    }
+                }
+            }
+            
+            if(!received) {
+                DropWorker(worker, workerIndex, slots);
+            }
+        }
+        
+        U64 now = GetTimeStamp();
+        U64 averageBandMicroseconds = doneCount ? bandMicrosecondsSum / doneCount : 0;
+        for(U32 workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+            DistributedWorker* worker = workers + workerIndex;
+            if(!worker->alive || worker->bandIndex != U32_MAX) {
+                continue;
+            }
+            
+            U32 bandIndex = PickBand(slots, bandCount, averageBandMicroseconds, now);
+            if(bandIndex == U32_MAX) {
+                break;
+            }
+            
+            DistributedBandSlot* slot = slots + bandIndex;
+            if(!SendDistributedMessage(worker->socket, DistributedMessage_Band, &slot->band, sizeof(slot->band), 0, 0)) {
+                DropWorker(worker, workerIndex, slots);
+                continue;
+            }
+            
+            if(slot->state == DistributedBandState_Pending) {
+                slot->state = DistributedBandState_Running;
+                slot->startTimeStamp = now;
+            } else {
+                printf("\nBand %lu is overdue, also given to worker %lu\n", bandIndex, workerIndex);
+            }
+            ++slot->runningCount;
+            worker->bandIndex = bandIndex;
+        }
+        
+        if(doneCount != printedDoneCount) {
+            printf("\rBands %lu of %lu done ", doneCount, bandCount);
+            fflush(stdout);
+            printedDoneCount = doneCount;
+        }
+    }
+    printf("\n");
+    
+    U64 microseconds = GetTimeStamp() - startTimeStamp;
+    
+    for(U32 workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        DistributedWorker* worker = workers + workerIndex;
+        
+        if(worker->alive) {
+            SendDistributedMessage(worker->socket, DistributedMessage_Quit, 0, 0, 0, 0);
+            CloseNetSocket(worker->socket);
+        }
+    }
+    CloseNetSocket(listenSocket);
+    FreeNetwork();
+    
+    ToneMap toneMap;
+    BuildToneMap(&toneMap, options->toneMapMode, options->exposure, options->srgbOutput);
+    
+    BMP_Image image;
+    InitBMPImage(&image, imageWidth, imageHeight);
+    ToneMapPixels(&toneMap, hdrPixelData, GetPackedPixelData(&image), pixelCount, 1.0f);
+    WriteBMPImage(&image, ResultFile);
+    
+    if(options->saveFloatImage) {
+        WritePFMImage(hdrPixelData, imageWidth, imageHeight, FloatResultFile);
+    }
+    
+    printf("\n-------------------------------------\n");
+    printf("Performance:\n");
+    printf("Microseconds: %llu\n", microseconds);
+    printf("Seconds:      %llu\n", (microseconds / 1000) / 1000);
+    PrintRayStats(stats, microseconds, (U64)pixelCount);
+    for(U32 workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        printf("  Worker %2lu:  %lu bands%s\n",
+               workerIndex, workers[workerIndex].bandsDone, workers[workerIndex].alive ? "" : ", lost");
+    }
+    printf("-------------------------------------\n");
+    
+    free(image.pixelData);
+    free(hdrPixelData);
+    free(discardRows);
+    free(slots);
+    
+    return true;
+}
+
+//NOTE(ans):
+// connects to the coordinator, retrying while it is not up yet, and renders the bands it asks for
+// until it sends quit or the connection drops
+static bool RunWorker(char* host, U32 port) {
+    if(!InitNetwork()) {
+        return false;
+    }
+    
+    NetSocket coordinator = NET_INVALID_SOCKET;
+    for(U32 attempt = 0; attempt < DISTRIBUTED_CONNECT_ATTEMPTS && coordinator == NET_INVALID_SOCKET; ++attempt) {
+        if(attempt) {
+            Sleep(1000);
+        }
+        
+        coordinator = ConnectTCP(host, port);
+    }
+    
+    if(coordinator == NET_INVALID_SOCKET) {
+        fprintf(stderr, "Not able to connect to %s:%lu . . .", host, port);
+        FreeNetwork();
+        return false;
+    }
+    
+    DistributedJob job;
+    if(!ReceiveDistributedHeader(coordinator, DistributedMessage_Job, sizeof(job)) ||
+       !ReceiveAll(coordinator, &job, sizeof(job)) ||
+       job.magic != DISTRIBUTED_MAGIC ||
+       job.version != DISTRIBUTED_VERSION ||
+       job.optionsSize != sizeof(Options) ||
+       job.pixelSize != sizeof(V3)) {
+        fprintf(stderr, "Coordinator sent no job or was built differently . . .");
+        CloseNetSocket(coordinator);
+        FreeNetwork();
+        return false;
+    }
+    
+    World world;
+    V3 cameraP;
+    
+    Scene scene = {};
+    if(job.sceneFileName[0]) {
+        job.sceneFileName[DISTRIBUTED_SCENE_NAME_SIZE - 1] = 0;
+        
+        if(!LoadScene(job.sceneFileName, &scene)) {
+            CloseNetSocket(coordinator);
+            FreeNetwork();
+            return false;
+        }
+        
+        world = scene.world;
+        cameraP = scene.cameraP;
+    } else {
+        BuildDefaultScene(&world, &cameraP);
+    }
+    
+    U32 imageWidth = job.imageWidth;
+    U32 imageHeight = job.imageHeight;
+    Options options = job.options;
+    
+    RenderCamera camera = SetupCamera(cameraP, imageWidth, imageHeight);
+    
+    SAAData saaData;
+    CalculateSAAData(options.saaMode,
+                     camera.filmWidth, camera.filmHeight,
+                     imageWidth, imageHeight,
+                     camera.cameraX, camera.cameraY,
+                     &saaData);
+    
+    RenderContext renderContext;
+    InitRenderContext(&renderContext);
+    
+    PrepareRender(&renderContext,
+                  imageHeight, imageWidth,
+                  camera.cameraP, camera.cameraX, camera.cameraY,
+                  camera.filmWidthHalf, camera.filmHeightHalf, camera.filmC,
+                  &world,
+                  0,
+                  0,
+                  &options,
+                  &saaData);
+    
+    V3* bandRows = 0;
+    U32 bandRowCapacity = 0;
+    U32 bandsDone = 0;
+    
+    printf("Rendering for %s:%lu . . .\n", host, port);
+    
+    for(;;) {
+        DistributedMessageHeader header;
+        if(!ReceiveAll(coordinator, &header, sizeof(header))) {
+            fprintf(stderr, "Lost the coordinator . . .");
+            break;
+        }
+        
+        if(header.type == DistributedMessage_Quit) {
+            break;
+        }
+        
+        DistributedBandResult bandResult;
+        if(header.type != DistributedMessage_Band ||
+           header.payloadSize != sizeof(DistributedBand) ||
+           !ReceiveAll(coordinator, &bandResult.band, sizeof(DistributedBand))) {
+            fprintf(stderr, "Coordinator sent an unknown message . . .");
+            break;
+        }
+        
+        DistributedBand band = bandResult.band;
+        if(band.y >= imageHeight || band.rowCount > imageHeight - band.y) {
+            fprintf(stderr, "Coordinator asked for rows outside of the image . . .");
+            break;
+        }
+        
+        if(band.rowCount > bandRowCapacity) {
+            free(bandRows);
+            bandRows = (V3*)malloc(sizeof(V3) * (size_t)imageWidth * (size_t)band.rowCount);
+            bandRowCapacity = band.rowCount;
+        }
+        
+        RayTraceRegion(&renderContext, imageWidth, band.y, band.rowCount, bandRows);
+        bandResult.stats = renderContext.stats;
+        
+        U64 rowsSize = sizeof(V3) * (U64)imageWidth * (U64)band.rowCount;
+        if(!SendDistributedMessage(coordinator, DistributedMessage_BandResult,
+                                   &bandResult, sizeof(bandResult),
+                                   bandRows, rowsSize)) {
+            fprintf(stderr, "Lost the coordinator . . .");
+            break;
+        }
+        
+        ++bandsDone;
+        printf("\rBands %lu rendered ", bandsDone);
+        fflush(stdout);
+    }
+    printf("\n");
+    
+    CloseNetSocket(coordinator);
+    FreeNetwork();
+    
+    FreeRenderContext(&renderContext);
+    FreeScene(&scene);
+    free(bandRows);
+    
+    return true;
+}
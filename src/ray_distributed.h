@@ -0,0 +1,85 @@
+/*
+Distributed
+
+a coordinator splits the image into bands of whole tile rows and hands them to worker processes
+over tcp, the workers render their band with RayTraceRegion and send the linear colors back.
+every sample seeds its own random series, so a band is bit identical on any worker and a band
+that is given out twice returns the same pixels.
+
+coordinator -> worker: job once, then band requests and quit
+worker -> coordinator: one band result per band request
+
+workers load the scene themselves, the coordinator only sends the file name.
+both sides have to be the same build, the job carries the struct sizes to catch mismatches.
+*/
+
+#define DISTRIBUTED_MAGIC 0x54534452
+#define DISTRIBUTED_VERSION 1
+
+#define DISTRIBUTED_MAX_WORKERS 32
+#define DISTRIBUTED_SCENE_NAME_SIZE 256
+
+enum DistributedMessageType {
+    DistributedMessage_Job,
+    DistributedMessage_Band,
+    DistributedMessage_BandResult,
+    DistributedMessage_Quit
+};
+
+//NOTE(ans): every message starts with this, payloadSize bytes follow
+struct DistributedMessageHeader {
+    U32 type;
+    U32 reserved;
+    U64 payloadSize;
+};
+
+//NOTE(ans): an empty sceneFileName renders BuildDefaultScene
+struct DistributedJob {
+    U32 magic;
+    U32 version;
+    U32 optionsSize;
+    U32 pixelSize;
+    
+    U32 imageWidth;
+    U32 imageHeight;
+    Options options;
+    
+    char sceneFileName[DISTRIBUTED_SCENE_NAME_SIZE];
+};
+
+struct DistributedBand {
+    U32 bandIndex;
+    U32 y;
+    U32 rowCount;
+    U32 reserved;
+};
+
+//NOTE(ans): followed by rowCount rows of V3
+struct DistributedBandResult {
+    DistributedBand band;
+    RayTraceStats stats;
+};
+
+enum DistributedBandState {
+    DistributedBandState_Pending,
+    DistributedBandState_Running,
+    DistributedBandState_Done
+};
+
+struct DistributedBandSlot {
+    DistributedBand band;
+    DistributedBandState state;
+    
+    //NOTE(ans): workers that currently render the band, more than one once a slow worker got overtaken
+    U32 runningCount;
+    U64 startTimeStamp;
+};
+
+struct DistributedWorker {
+    NetSocket socket;
+    bool alive;
+    
+    //NOTE(ans): U32_MAX while the worker waits for a band
+    U32 bandIndex;
+    U32 bandsDone;
+};
@@ -38,24 +38,47 @@ typedef float			   F32;
 #define U32_MAX ULONG_MAX
 #define ArraySize(array) sizeof(array) / sizeof(array[0]);
 
+//NOTE(ans): 
+// 1 takes SquareRoot and Normalize from sse instructions, V3 itself stays 12 bytes of scalars
+// so the scene files do not change, see Performance.md
+#ifndef MATH_SIMD_V3
+#define MATH_SIMD_V3 0
+#endif
+
 #include "ray_math.h"
+#include "ray_simd.h"
 #include "ray_bmp.h"
 #include "ray_bmp.cpp"
 
+#include "ray_bvh.h"
 #include "ray_world.h"
+#include "ray_tiles.h"
 #include "ray_tracing.h"
+#include "ray_wavefront.h"
+#include "ray_shadowmap.h"
+#include "ray_visibility.h"
 
 #define DEBUG_DISABLE_PARALLEL_THREADING 0
 #include "ray_os.cpp"
+#include "ray_tiles.cpp"
+#include "ray_bvh.cpp"
+#include "ray_scene.h"
+#include "ray_scene.cpp"
 
 #define DEBUG_SELFINTERSECTION 1
 #define DEBUG_DISABLE_SHADING  0
 #include "ray_tracing.cpp"
+#include "ray_wavefront.cpp"
+#include "ray_shadowmap.cpp"
+#include "ray_visibility.cpp"
 
 /*
 Defines
 */
 #define ResultFile "result.bmp"
+#define FloatResultFile "result.pfm"
+#define CostResultFile "cost.bmp"
+#define ReshadeResultFile "reshade.bmp"
 
 static void CalculateCameraAxis(V3 cameraP,
                                 V3* cameraX, V3* cameraY, V3* cameraZ) {
@@ -64,14 +87,43 @@ static void CalculateCameraAxis(V3 cameraP,
     *cameraY = Normalize(Cross(*cameraZ, *cameraX));
 }
 
-int main() {
-    printf("Start ray tracing . . .\n");
+struct RenderCamera {
+    V3 cameraP;
+    V3 cameraX;
+    V3 cameraY;
+    
+    F32 filmWidth;
+    F32 filmHeight;
+    F32 filmWidthHalf;
+    F32 filmHeightHalf;
+    V3 filmC;
+};
+
+static RenderCamera SetupCamera(V3 cameraP, U32 imageWidth, U32 imageHeight) {
+    RenderCamera result;
+    result.cameraP = cameraP;
     
-    BMP_Image image;
-    InitBMPImage(&image,
-                 1280, 720);
+    //NOTE(ans): setup camera looking at origin
+    V3 cameraZ;
+    CalculateCameraAxis(cameraP, &result.cameraX, &result.cameraY, &cameraZ);
+    
+    //NOTE(ans): setup film area to shoot rays through
+    F32 distToCamera = 1;
+    result.filmC = cameraP - (cameraZ * distToCamera);
     
-    Material materials[] 
+    //NOTE(ans): assumes that the the max of width and height is 1 in vp space
+    //TODO: handle that height is greater then width 
+    result.filmWidth = 1;
+    result.filmHeight = (F32)imageHeight / (F32)imageWidth;  
+    result.filmWidthHalf = result.filmWidth * 0.5f;
+    result.filmHeightHalf = result.filmHeight * 0.5f;
+    
+    return result;
+}
+
+//NOTE(ans): rendered when no scene file is given, the arrays stay alive for the whole run
+static void BuildDefaultScene(World* world, V3* cameraP) {
+    static Material materials[] = 
     {
         {{0.2,0.6,0.8}, 0,    1},
         {{0.8,0.8,0.8}, 0,    1},
@@ -82,104 +134,388 @@ int main() {
         {{0,0,1},       0.5f, 0.5f}
     };
     
-    Plane planes[] = 
+    static Plane planes[] = 
     {
         {0, {0,0,1}, {0,0,0}, 5, 4}
     };
     
-    Sphere spheres[] = {
+    static Sphere spheres[] = {
         {1, {-2,0,1}, 1, 2},
         {2, {0,0,1},  1, 3},
         {3, {2,0,1},  1, 6}
     };
     
-    Light lights[] = {
+    static Light lights[] = {
         {{1,1,1},   0.5, LightType_Directional, {-0.5, 0, 1}},
         {{1,1,1},   500, LightType_Point,       {3,  0, 5}},
         {{1,1,0.4}, 500, LightType_Point,       {-3, 0, 6}}
     };
     
-    World world;
-    world.materials = materials;
-    world.planes = planes;
-    world.planeCount = ArraySize(planes);
-    world.spheres = spheres;
-    world.sphereCount = ArraySize(spheres);
-    world.lights = lights;
-    world.lightCount = ArraySize(lights);
+    world->materials = materials;
+    world->planes = planes;
+    world->planeCount = ArraySize(planes);
+    world->spheres = spheres;
+    world->sphereCount = ArraySize(spheres);
+    world->lights = lights;
+    world->lightCount = ArraySize(lights);
+    
+    BuildWorldAcceleration(world);
     
+    *cameraP = {0, -20, 5};
+}
+
+//NOTE(ans): the named option sets, shared by main and the benchmark
+static bool GetOptionsPreset(char* name, Options* result) {
     Options maxOptions;
     maxOptions.saaMode = SAAMode_SSAA;
     maxOptions.samplesToTake = 16;
     maxOptions.samplesPerDim = 4;
-    maxOptions.samplesPerShading = 256;
+    maxOptions.samplesMax = 64;
+    maxOptions.sampleVarianceThreshold = 0.02f;
+    //NOTE(ans): 64 sobol samples are less noisy than the 256 of the old circle table, see Performance.md
+    maxOptions.samplesPerShading = 64;
+    maxOptions.samplesPerShadingPilot = 16;
     maxOptions.sampleRegionSize = 0.5;
+    maxOptions.shadowMapSize = 0;
+    maxOptions.visibilityCacheSize = 0;
+    maxOptions.visibilityCacheSpacing = 0.25f;
+    maxOptions.throughputCutoff = 0.01f;
+    maxOptions.russianRoulette = 0;
+    maxOptions.diffuseBounce = 0;
+    for(U32 depth = 0; depth <= REFLECTION_MAX_DEPTH; ++depth) {
+        maxOptions.samplesPerShadingAtDepth[depth] = 0;
+    }
+    maxOptions.samplesPerShadingMin = 0;
+    maxOptions.randomSeed = 1;
+    maxOptions.frameIndex = 0;
+    maxOptions.tileSize = 16;
+    maxOptions.packetDim = 4;
+    maxOptions.wavefront = 0;
+    maxOptions.cachePrimaryHits = 0;
+    maxOptions.progressivePasses = 0;
+    maxOptions.progressiveSnapshotSeconds = 10;
+    maxOptions.streamOutput = 0;
+    maxOptions.toneMapMode = ToneMapMode_Clamp;
+    maxOptions.exposure = 1.0f;
+    maxOptions.srgbOutput = 1;
+    maxOptions.saveFloatImage = 0;
+    maxOptions.saveCostImage = 0;
     
     Options devOptions;
     devOptions.saaMode = SAAMode_SSAA;
     devOptions.samplesToTake = 4;
     devOptions.samplesPerDim = 2;
-    devOptions.samplesPerShading = 128;
+    devOptions.samplesMax = 16;
+    devOptions.sampleVarianceThreshold = 0.02f;
+    //NOTE(ans): 32 instead of 128 for the same reason as max, the pilots stay a quarter of the samples
+    devOptions.samplesPerShading = 32;
+    devOptions.samplesPerShadingPilot = 8;
     devOptions.sampleRegionSize = 0.5;
+    devOptions.shadowMapSize = 0;
+    devOptions.visibilityCacheSize = 0;
+    devOptions.visibilityCacheSpacing = 0.25f;
+    devOptions.throughputCutoff = 0.01f;
+    devOptions.russianRoulette = 0;
+    devOptions.diffuseBounce = 0;
+    for(U32 depth = 0; depth <= REFLECTION_MAX_DEPTH; ++depth) {
+        devOptions.samplesPerShadingAtDepth[depth] = 0;
+    }
+    devOptions.samplesPerShadingMin = 0;
+    devOptions.randomSeed = 1;
+    devOptions.frameIndex = 0;
+    devOptions.tileSize = 16;
+    devOptions.packetDim = 4;
+    devOptions.wavefront = 0;
+    devOptions.cachePrimaryHits = 0;
+    devOptions.progressivePasses = 0;
+    devOptions.progressiveSnapshotSeconds = 10;
+    devOptions.streamOutput = 0;
+    devOptions.toneMapMode = ToneMapMode_Clamp;
+    devOptions.exposure = 1.0f;
+    devOptions.srgbOutput = 1;
+    devOptions.saveFloatImage = 0;
+    devOptions.saveCostImage = 0;
     
     
     Options devOptionsMinimal;
     devOptionsMinimal.saaMode = SAAMode_SSAA;
     devOptionsMinimal.samplesToTake = 1;
     devOptionsMinimal.samplesPerDim = 1;
+    devOptionsMinimal.samplesMax = 1;
+    devOptionsMinimal.sampleVarianceThreshold = 0.02f;
     devOptionsMinimal.samplesPerShading = 1;
+    devOptionsMinimal.samplesPerShadingPilot = 0;
     devOptionsMinimal.sampleRegionSize = 0.5;
+    devOptionsMinimal.shadowMapSize = 0;
+    devOptionsMinimal.visibilityCacheSize = 0;
+    devOptionsMinimal.visibilityCacheSpacing = 0.25f;
+    devOptionsMinimal.throughputCutoff = 0.01f;
+    devOptionsMinimal.russianRoulette = 0;
+    devOptionsMinimal.diffuseBounce = 0;
+    for(U32 depth = 0; depth <= REFLECTION_MAX_DEPTH; ++depth) {
+        devOptionsMinimal.samplesPerShadingAtDepth[depth] = 0;
+    }
+    devOptionsMinimal.samplesPerShadingMin = 0;
+    devOptionsMinimal.randomSeed = 1;
+    devOptionsMinimal.frameIndex = 0;
+    devOptionsMinimal.tileSize = 16;
+    devOptionsMinimal.packetDim = 4;
+    devOptionsMinimal.wavefront = 0;
+    devOptionsMinimal.cachePrimaryHits = 0;
+    devOptionsMinimal.progressivePasses = 0;
+    devOptionsMinimal.progressiveSnapshotSeconds = 10;
+    devOptionsMinimal.streamOutput = 0;
+    devOptionsMinimal.toneMapMode = ToneMapMode_Clamp;
+    devOptionsMinimal.exposure = 1.0f;
+    devOptionsMinimal.srgbOutput = 1;
+    devOptionsMinimal.saveFloatImage = 0;
+    devOptionsMinimal.saveCostImage = 0;
     
     
-    Options options = devOptionsMinimal;
-    options = devOptions;
-    options = maxOptions;
+    Options adaptiveOptions = maxOptions;
+    adaptiveOptions.saaMode = SAAMode_Adaptive;
+    adaptiveOptions.samplesToTake = 4;
+    adaptiveOptions.samplesMax = 16;
     
-    U32 imageHeight; 
-    U32 imageWidth;
-    GetDimensions(&image, &imageHeight, &imageWidth);
+    //NOTE(ans): writes result.bmp every 10 seconds while it converges
+    Options progressiveOptions = devOptions;
+    progressiveOptions.progressivePasses = 256;
     
-    U32* packedPixelData = GetPackedPixelData(&image);
+    Options wavefrontOptions = maxOptions;
+    wavefrontOptions.wavefront = 1;
     
-    //NOTE(ans): setup camera looking at origin
-    V3 cameraP = {0, -20, 5};
-    V3 cameraX, cameraY, cameraZ;
-    CalculateCameraAxis(cameraP, &cameraX, &cameraY, &cameraZ);
+    //NOTE(ans): for images that do not fit into memory, only a few tile rows are kept at a time
+    Options streamedOptions = maxOptions;
+    streamedOptions.streamOutput = 1;
     
-    //NOTE(ans): setup film area to shoot rays through
-    F32 distToCamera = 1;
-    V3 filmC = cameraP - (cameraZ * distToCamera);
+    //NOTE(ans): the samples of max, but every object in a pixel gets shaded once
+    Options msaaOptions = maxOptions;
+    msaaOptions.saaMode = SAAMode_MSAA;
     
-    //NOTE(ans): assumes that the the max of width and height is 1 in vp space
-    //TODO: handle that height is greater then width 
-    F32 filmWidth = 1;
-    F32 filmHeight = (F32)imageHeight / (F32)imageWidth;  
-    F32 filmWidthHalf = filmWidth * 0.5f;
-    F32 filmHeightHalf = filmHeight * 0.5f;
+    //NOTE(ans): the directional light looks its shadows up in a map, only silhouettes trace rays
+    Options shadowMapOptions = maxOptions;
+    shadowMapOptions.shadowMapSize = 2048;
+    
+    //NOTE(ans): the soft shadows on the ground come from a cache, 16 bytes per entry
+    Options visibilityOptions = maxOptions;
+    visibilityOptions.visibilityCacheSize = 1 << 20;
+    
+    //NOTE(ans): reflections take fewer light samples the deeper and fainter they are
+    Options budgetOptions = maxOptions;
+    budgetOptions.samplesPerShadingAtDepth[1] = 16;
+    for(U32 depth = 2; depth <= REFLECTION_MAX_DEPTH; ++depth) {
+        budgetOptions.samplesPerShadingAtDepth[depth] = 4;
+    }
+    budgetOptions.samplesPerShadingMin = 4;
+    
+    //NOTE(ans): paths below throughputCutoff go on at random instead of stopping, unbiased but noisier
+    Options rouletteOptions = maxOptions;
+    rouletteOptions.russianRoulette = 1;
+    
+    //NOTE(ans): keeps the primary hits for -relight, the benchmark times ReshadeImage with it
+    Options lookDevOptions = devOptions;
+    lookDevOptions.cachePrimaryHits = 1;
+    
+    //NOTE(ans): writes cost.bmp next to the result, the timing adds a little to every pixel
+    Options costOptions = maxOptions;
+    costOptions.saveCostImage = 1;
+    
+    struct {
+        char* name;
+        Options* options;
+    } presets[] = {
+        {"max",         &maxOptions},
+        {"dev",         &devOptions},
+        {"minimal",     &devOptionsMinimal},
+        {"adaptive",    &adaptiveOptions},
+        {"progressive", &progressiveOptions},
+        {"wavefront",   &wavefrontOptions},
+        {"streamed",    &streamedOptions},
+        {"cost",        &costOptions},
+        {"lookdev",     &lookDevOptions},
+        {"msaa",        &msaaOptions},
+        {"shadowmap",   &shadowMapOptions},
+        {"visibility",  &visibilityOptions},
+        {"budget",      &budgetOptions},
+        {"roulette",    &rouletteOptions}
+    };
     
+    U32 presetCount = ArraySize(presets);
+    for(U32 presetIndex = 0; presetIndex < presetCount; ++presetIndex) {
+        if(strcmp(presets[presetIndex].name, name) == 0) {
+            *result = *presets[presetIndex].options;
+            
+            return true;
+        }
+    }
+    
+    fprintf(stderr, "Unknown options preset %s . . .", name);
+    
+    return false;
+}
+
+#include "ray_distributed.h"
+#include "ray_distributed.cpp"
+
+#if !RAY_BENCHMARK
+
+#define DefaultPreset "max"
+
+//NOTE(ans):
+// RayTracer                              renders the scene above with the max preset
+// RayTracer scene.rscn                   renders a binary scene
+// RayTracer -preset dev [scene.rscn]     renders with one of the presets in GetOptionsPreset
+// RayTracer -preset lookdev -relight 0 2 renders, then sets the intensity of light 0 to 2 and
+//                                        writes reshade.bmp with ReshadeImage from the kept primary hits
+// RayTracer convert scene.txt scene.rscn writes a binary scene from the text format in ray_scene.h
+int main(int argumentCount, char** arguments) {
+    if(argumentCount == 4 && strcmp(arguments[1], "convert") == 0) {
+        bool converted = ConvertSceneText(arguments[2], arguments[3]);
+        
+        return converted ? 0 : 1;
+    }
+    
+    if(argumentCount == 4 && strcmp(arguments[1], "-worker") == 0) {
+        bool rendered = RunWorker(arguments[2], (U32)atoi(arguments[3]));
+        
+        return rendered ? 0 : 1;
+    }
+    
+    char* presetName = DefaultPreset;
+    char* sceneFileName = 0;
+    U32 coordinatorPort = 0;
+    U32 relightIndex = U32_MAX;
+    F32 relightIntensity = 0;
+    for(int argumentIndex = 1; argumentIndex < argumentCount; ++argumentIndex) {
+        if(strcmp(arguments[argumentIndex], "-preset") == 0 && argumentIndex + 1 < argumentCount) {
+            presetName = arguments[++argumentIndex];
+        } else if(strcmp(arguments[argumentIndex], "-coordinate") == 0 && argumentIndex + 1 < argumentCount) {
+            coordinatorPort = (U32)atoi(arguments[++argumentIndex]);
+        } else if(strcmp(arguments[argumentIndex], "-relight") == 0 && argumentIndex + 2 < argumentCount) {
+            relightIndex = (U32)atoi(arguments[++argumentIndex]);
+            relightIntensity = (F32)atof(arguments[++argumentIndex]);
+        } else {
+            sceneFileName = arguments[argumentIndex];
+        }
+    }
+    
+    Options options;
+    if(!GetOptionsPreset(presetName, &options)) {
+        return 1;
+    }
+    
+    U32 imageWidth = 1280;
+    U32 imageHeight = 720;
+    
+    //NOTE(ans): the workers load the scene themselves, so it has to be at the same path on their machines
+    if(coordinatorPort) {
+        bool rendered = RunCoordinator(coordinatorPort, sceneFileName, &options, imageWidth, imageHeight);
+        
+        return rendered ? 0 : 1;
+    }
+    
+    printf("Start ray tracing . . .\n");
+    
+    World world;
+    V3 cameraP;
+    
+    Scene scene = {};
+    if(sceneFileName) {
+        U64 loadStartTimeStamp = GetTimeStamp();
+        
+        if(!LoadScene(sceneFileName, &scene)) {
+            return 1;
+        }
+        
+        world = scene.world;
+        cameraP = scene.cameraP;
+        
+        printf("Scene loaded in %llu microseconds\n", GetTimeStamp() - loadStartTimeStamp);
+    } else {
+        BuildDefaultScene(&world, &cameraP);
+    }
+    
+    //NOTE(ans): the streamed render never holds the whole image
+    BMP_Image image = {};
+    V3* hdrPixelData = 0;
+    F32* pixelCostData = 0;
+    if(!options.streamOutput) {
+        InitBMPImage(&image,
+                     imageWidth, imageHeight);
+        hdrPixelData = (V3*)malloc(sizeof(V3) * (size_t)imageWidth * (size_t)imageHeight);
+        
+        if(options.saveCostImage) {
+            pixelCostData = (F32*)malloc(sizeof(F32) * (size_t)imageWidth * (size_t)imageHeight);
+        }
+    }
+    
+    U32* packedPixelData = GetPackedPixelData(&image);
+    
+    RenderCamera camera = SetupCamera(cameraP, imageWidth, imageHeight);
     
     SAAData saaData;
     CalculateSAAData(options.saaMode,
-                     filmWidth, filmHeight,
+                     camera.filmWidth, camera.filmHeight,
                      imageWidth, imageHeight,
-                     cameraX, cameraY,
+                     camera.cameraX, camera.cameraY,
                      &saaData);
     
+    RenderContext renderContext;
+    InitRenderContext(&renderContext);
+    
     U64 startTimeStamp = GetTimeStamp();
     U64 startTicks = GetCPUTicks(); 
     
-    RayTraceImage(imageHeight, imageWidth,
-                  cameraP, cameraX, cameraY,
-                  filmWidthHalf, filmHeightHalf, filmC,
-                  &world,
-                  packedPixelData,
-                  &options,
-                  &saaData);
+    if(options.progressivePasses) {
+        RayTraceImageProgressive(&renderContext,
+                                 imageHeight, imageWidth,
+                                 camera.cameraP, camera.cameraX, camera.cameraY,
+                                 camera.filmWidthHalf, camera.filmHeightHalf, camera.filmC,
+                                 &world,
+                                 hdrPixelData,
+                                 pixelCostData,
+                                 &image, ResultFile,
+                                 &options,
+                                 &saaData);
+    } else if(options.streamOutput) {
+        RayTraceImageStreamed(&renderContext,
+                              imageHeight, imageWidth,
+                              camera.cameraP, camera.cameraX, camera.cameraY,
+                              camera.filmWidthHalf, camera.filmHeightHalf, camera.filmC,
+                              &world,
+                              ResultFile, FloatResultFile,
+                              &options,
+                              &saaData);
+    } else {
+        RayTraceImage(&renderContext,
+                      imageHeight, imageWidth,
+                      camera.cameraP, camera.cameraX, camera.cameraY,
+                      camera.filmWidthHalf, camera.filmHeightHalf, camera.filmC,
+                      &world,
+                      hdrPixelData,
+                      pixelCostData,
+                      &options,
+                      &saaData);
+    }
     
     U64 endTicks = GetCPUTicks();
     U64 endTimeStamp = GetTimeStamp();
     
-    WriteBMPImage(&image, ResultFile);
+    if(!options.progressivePasses && !options.streamOutput) {
+        U64 toneMapStartTimeStamp = GetTimeStamp();
+        ToneMapImage(&renderContext, hdrPixelData, packedPixelData, GetPixelCount(&image), 1.0f);
+        printf("Tone mapped in %llu microseconds\n", GetTimeStamp() - toneMapStartTimeStamp);
+        
+        WriteBMPImage(&image, ResultFile);
+    }
+    
+    if(options.saveFloatImage && !options.streamOutput) {
+        WritePFMImage(hdrPixelData, imageWidth, imageHeight, FloatResultFile);
+    }
+    
+    if(pixelCostData) {
+        WriteCostImage(pixelCostData, imageWidth, imageHeight, CostResultFile);
+    }
     
     U64 microseconds = endTimeStamp - startTimeStamp;
     printf("\n-------------------------------------\n");
@@ -187,8 +523,44 @@ int main() {
     printf("Ticks:        %llu\n", endTicks - startTicks);
     printf("Microseconds: %llu\n", microseconds);
     printf("Seconds:      %llu\n", (microseconds / 1000) / 1000);
+    
+    PrintRenderReport(&renderContext, microseconds, (U64)imageWidth * (U64)imageHeight);
     printf("-------------------------------------\n");
     
+    //NOTE(ans): the lights of a loaded scene sit in the read only mapping, the change goes to a copy
+    if(relightIndex != U32_MAX && hdrPixelData) {
+        if(relightIndex < world.lightCount) {
+            Light* lights = (Light*)malloc(sizeof(Light) * world.lightCount);
+            memcpy(lights, world.lights, sizeof(Light) * world.lightCount);
+            lights[relightIndex].intensity = relightIntensity;
+            
+            World relitWorld = world;
+            relitWorld.lights = lights;
+            
+            U64 reshadeStartTimeStamp = GetTimeStamp();
+            if(ReshadeImage(&renderContext, &relitWorld, hdrPixelData, 0, &options)) {
+                printf("Reshaded in %llu microseconds\n", GetTimeStamp() - reshadeStartTimeStamp);
+                
+                ToneMapImage(&renderContext, hdrPixelData, packedPixelData, GetPixelCount(&image), 1.0f);
+                WriteBMPImage(&image, ReshadeResultFile);
+            } else {
+                fprintf(stderr, "-relight needs a preset with cachePrimaryHits, like lookdev . . .\n");
+            }
+            
+            free(lights);
+        } else {
+            fprintf(stderr, "The scene has no light %lu to relight . . .\n", relightIndex);
+        }
+    }
+    
+    FreeRenderContext(&renderContext);
+    FreeScene(&scene);
+    free(image.pixelData);
+    free(hdrPixelData);
+    free(pixelCostData);
+    
     printf("Finished ray tracing . . .\n");
     return 0;
-}
\ No newline at end of file
+}
+
+#endif
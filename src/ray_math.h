@@ -1,5 +1,9 @@
 #include "math.h"
 
+#if MATH_SIMD_V3
+#include <immintrin.h>
+#endif
+
 /*
 Constants
 */
@@ -44,6 +48,80 @@ static U32 RandomU32(RandomSeries* series, U32 max) {
     return result;
 }
 
+//NOTE(ans): ref https://nullprogram.com/blog/2018/07/31/ lowbias32, every input bit flips about half of the output bits
+static inline U32 HashU32(U32 x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    
+    return x;
+}
+
+//NOTE(ans): 
+// series of one sample of one pixel, the same inputs always give the same numbers no matter
+// which thread or machine renders the pixel. xorshift stays at 0 forever, so 0 gets replaced
+static inline RandomSeries SampleRandomSeries(U32 pixelX, U32 pixelY, U32 sampleIndex, U32 frameIndex, U32 seed) {
+    U32 hash = HashU32(seed);
+    hash = HashU32(hash ^ pixelX);
+    hash = HashU32(hash ^ pixelY);
+    hash = HashU32(hash ^ sampleIndex);
+    hash = HashU32(hash ^ frameIndex);
+    
+    RandomSeries result;
+    result.series = hash ? hash : 1;
+    
+    return result;
+}
+
+//NOTE(ans): radical inverse of index, base 2 and 3 give a halton point set in [0, 1)
+static F32 Halton(U32 index, U32 base) {
+    F32 result = 0;
+    F32 fraction = 1.0f / (F32)base;
+    
+    while(index > 0) {
+        result += (F32)(index % base) * fraction;
+        index /= base;
+        fraction /= (F32)base;
+    }
+    
+    return result;
+}
+
+//NOTE(ans): first dimension of the sobol sequence, the bits of the index reversed
+static inline U32 SobolFirstU32(U32 index) {
+    index = (index << 16) | (index >> 16);
+    index = ((index & 0x00FF00FF) << 8) | ((index & 0xFF00FF00) >> 8);
+    index = ((index & 0x0F0F0F0F) << 4) | ((index & 0xF0F0F0F0) >> 4);
+    index = ((index & 0x33333333) << 2) | ((index & 0xCCCCCCCC) >> 2);
+    index = ((index & 0x55555555) << 1) | ((index & 0xAAAAAAAA) >> 1);
+    
+    return index;
+}
+
+//NOTE(ans):
+// second dimension of the sobol sequence. together with the first one every power of 2
+// prefix of the sequence puts exactly one point into every stratum of the unit square
+static inline U32 SobolSecondU32(U32 index) {
+    U32 result = 0;
+    
+    for(U32 v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+        if(index & 1) {
+            result ^= v;
+        }
+    }
+    
+    return result;
+}
+
+//returns values between 0 and 1, only the upper 24 bits fit into a F32
+static inline F32 UnitF32(U32 bits) {
+    F32 result = (F32)(bits >> 8) * (1.0f / 16777216.0f);
+    
+    return result;
+}
+
 /*
 F32
 */
@@ -58,7 +136,11 @@ static inline F32 Pow(F32 x, F32 y) {
 static inline F32 SquareRoot(F32 v) {
     F32 result;
     
+#if MATH_SIMD_V3
+    result = _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(v)));
+#else
     result = (F32)sqrt((double)v);
+#endif
     
     return result;
 }
@@ -73,6 +155,16 @@ static inline F32 Max(F32 v1, F32 v2) {
     return result;
 }
 
+static inline F32 Min(F32 v1, F32 v2) {
+    F32 result = v1;
+    
+    if(result > v2) {
+        result = v2;
+    }
+    
+    return result;
+}
+
 /*
 V3
 */
@@ -106,6 +198,16 @@ V3 inline operator+(V3 v1, V3 v2) {
     return result;
 }
 
+V3 operator+(V3 v, F32 c) {
+    V3 result;
+    
+    result.x = v.x + c;
+    result.y = v.y + c;
+    result.z = v.z + c;
+    
+    return result;
+}
+
 V3 operator-(V3 v1, V3 v2) {
     V3 result;
     
@@ -193,13 +295,46 @@ static inline V3 Hadamard(V3 v1, V3 v2) {
     return result;
 }
 
+static inline V3 Min(V3 v1, V3 v2) {
+    V3 result;
+    
+    result.x = Min(v1.x, v2.x);
+    result.y = Min(v1.y, v2.y);
+    result.z = Min(v1.z, v2.z);
+    
+    return result;
+}
+
+static inline V3 Max(V3 v1, V3 v2) {
+    V3 result;
+    
+    result.x = Max(v1.x, v2.x);
+    result.y = Max(v1.y, v2.y);
+    result.z = Max(v1.z, v2.z);
+    
+    return result;
+}
+
+//NOTE(ans): 
+// with MATH_SIMD_V3 rsqrt replaces the sqrt and the divide. rsqrt is only good for 12 bits,
+// one newton step y * (1.5 - 0.5 * x * y * y) brings it close to full float precision
 static inline V3 Normalize(V3 v) {
     V3 result;
     
     F32 innerProduct = Inner(v, v);
+    
+#if MATH_SIMD_V3
+    __m128 x = _mm_set_ss(innerProduct);
+    __m128 y = _mm_rsqrt_ss(x);
+    __m128 halfXYY = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), x), _mm_mul_ss(y, y));
+    y = _mm_mul_ss(y, _mm_sub_ss(_mm_set_ss(1.5f), halfXYY));
+    
+    result = v * _mm_cvtss_f32(y);
+#else
     F32 length = SquareRoot(innerProduct);
     
     result = v / length;
+#endif
     
     return result;
 }
@@ -1,8 +1,13 @@
 /*
 Windows
 */
+//NOTE(ans): winsock2.h has to come before windows.h, which pulls in the old winsock.h otherwise
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
 
+#pragma comment(lib, "Ws2_32.lib")
+
 #define DebuggerBreak() DebugBreak()
 
 static U64 GetCPUTicks() {
@@ -45,39 +50,369 @@ static U32 GetCPUCores() {
     return processorCount;
 }
 
-typedef DWORD (*ThreadFunction)(void* data);
-void CreateMultipleThreadsAndWait(ThreadFunction threadFunction, RayTraceSectionRowData* threadDataList, int dataCount) {
-    //NOTE(ans): not freed atm
-    HANDLE* nativeHandles = (HANDLE*)malloc(sizeof(HANDLE) * dataCount);
+static U64 AtomicCompareExchangeU64(volatile U64* destination, U64 exchange, U64 comparand) {
+    LONG64 result = InterlockedCompareExchange64((volatile LONG64*)destination,
+                                                 (LONG64)exchange,
+                                                 (LONG64)comparand);
     
-#if DEBUG_DISABLE_PARALLEL_THREADING
-    for(int i = 0; i < dataCount; ++i) {
-        RayTraceSectionRowData* threadData = threadDataList + i;
+    return (U64)result;
+}
+
+typedef void (*ThreadPoolJob)(void* jobData, U32 threadIndex);
+
+struct ThreadPool;
+struct ThreadPoolWorker {
+    ThreadPool* pool;
+    U32 threadIndex;
+};
+
+struct ThreadPool {
+    U32 threadCount;
+    HANDLE* threadHandles;
+    HANDLE* startEvents;
+    ThreadPoolWorker* workers;
+    
+    HANDLE doneEvent;
+    volatile LONG pendingCount;
+    volatile LONG shutdown;
+    
+    ThreadPoolJob job;
+    void* jobData;
+};
+
+static DWORD WINAPI ThreadPoolWorkerMain(void* data) {
+    ThreadPoolWorker* worker = (ThreadPoolWorker*)data;
+    ThreadPool* pool = worker->pool;
+    
+    for(;;) {
+        WaitForSingleObject(pool->startEvents[worker->threadIndex], INFINITE);
         
-        DWORD threadId;
-        HANDLE threadHandle = CreateThread(NULL,
-                                           0,
-                                           (LPTHREAD_START_ROUTINE)threadFunction,
-                                           threadData,
-                                           0,
-                                           &threadId);
+        if(pool->shutdown) {
+            break;
+        }
+        
+        pool->job(pool->jobData, worker->threadIndex);
         
-        WaitForSingleObject(threadHandle, INFINITE);
+        if(InterlockedDecrement(&pool->pendingCount) == 0) {
+            SetEvent(pool->doneEvent);
+        }
     }
-#else
     
-    for(int i = 0; i < dataCount; ++i) {
-        RayTraceSectionRowData* threadData = threadDataList + i;
+    return 0;
+}
+
+//NOTE(ans):
+// threads are created once and sleep on their own start event between jobs,
+// every job is run exactly once on every thread of the pool
+static void InitThreadPool(ThreadPool* pool, U32 threadCount) {
+    pool->threadCount = threadCount;
+    pool->threadHandles = (HANDLE*)malloc(sizeof(HANDLE) * threadCount);
+    pool->startEvents = (HANDLE*)malloc(sizeof(HANDLE) * threadCount);
+    pool->workers = (ThreadPoolWorker*)malloc(sizeof(ThreadPoolWorker) * threadCount);
+    pool->doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    pool->pendingCount = 0;
+    pool->shutdown = 0;
+    pool->job = 0;
+    pool->jobData = 0;
+    
+#if !DEBUG_DISABLE_PARALLEL_THREADING
+    for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        ThreadPoolWorker* worker = pool->workers + threadIndex;
+        worker->pool = pool;
+        worker->threadIndex = threadIndex;
+        
+        pool->startEvents[threadIndex] = CreateEvent(NULL, FALSE, FALSE, NULL);
         
         DWORD threadId;
-        *(nativeHandles + i) = CreateThread(NULL,
-                                            0,
-                                            (LPTHREAD_START_ROUTINE)threadFunction,
-                                            threadData,
-                                            0,
-                                            &threadId);
+        pool->threadHandles[threadIndex] = CreateThread(NULL,
+                                                        0,
+                                                        (LPTHREAD_START_ROUTINE)ThreadPoolWorkerMain,
+                                                        worker,
+                                                        0,
+                                                        &threadId);
+    }
+#endif
+}
+
+static void RunThreadPool(ThreadPool* pool, ThreadPoolJob job, void* jobData) {
+#if DEBUG_DISABLE_PARALLEL_THREADING
+    for(U32 threadIndex = 0; threadIndex < pool->threadCount; ++threadIndex) {
+        job(jobData, threadIndex);
+    }
+#else
+    pool->job = job;
+    pool->jobData = jobData;
+    pool->pendingCount = (LONG)pool->threadCount;
+    
+    for(U32 threadIndex = 0; threadIndex < pool->threadCount; ++threadIndex) {
+        SetEvent(pool->startEvents[threadIndex]);
+    }
+    
+    WaitForSingleObject(pool->doneEvent, INFINITE);
+#endif
+}
+
+static void FreeThreadPool(ThreadPool* pool) {
+#if !DEBUG_DISABLE_PARALLEL_THREADING
+    pool->shutdown = 1;
+    
+    for(U32 threadIndex = 0; threadIndex < pool->threadCount; ++threadIndex) {
+        SetEvent(pool->startEvents[threadIndex]);
     }
     
-    WaitForMultipleObjects(dataCount,nativeHandles, true, INFINITE);
+    //NOTE(ans): WaitForMultipleObjects is limited to 64 handles
+    for(U32 threadIndex = 0; threadIndex < pool->threadCount; ++threadIndex) {
+        WaitForSingleObject(pool->threadHandles[threadIndex], INFINITE);
+        CloseHandle(pool->threadHandles[threadIndex]);
+        CloseHandle(pool->startEvents[threadIndex]);
+    }
 #endif
+    
+    CloseHandle(pool->doneEvent);
+    
+    free(pool->threadHandles);
+    free(pool->startEvents);
+    free(pool->workers);
+}
+
+struct MappedFile {
+    void* memory;
+    U64 size;
+    
+    HANDLE file;
+    HANDLE mapping;
+};
+
+//NOTE(ans): 
+// maps the whole file read only, nothing is read up front. 
+// the os pages the file in on first access and can drop the pages again without writing them
+static bool MapFileReadOnly(char* fileName, MappedFile* result) {
+    *result = {};
+    
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, 
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        DWORD errorCode = GetLastError();
+        printf("WIN_API error occured: %lu\n", errorCode);
+        return false;
+    }
+    
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping) {
+        DWORD errorCode = GetLastError();
+        printf("WIN_API error occured: %lu\n", errorCode);
+        CloseHandle(file);
+        return false;
+    }
+    
+    void* memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!memory) {
+        DWORD errorCode = GetLastError();
+        printf("WIN_API error occured: %lu\n", errorCode);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    
+    result->memory = memory;
+    result->size = (U64)fileSize.QuadPart;
+    result->file = file;
+    result->mapping = mapping;
+    
+    return true;
+}
+
+static void UnmapFile(MappedFile* file) {
+    if(file->memory) {
+        UnmapViewOfFile(file->memory);
+        CloseHandle(file->mapping);
+        CloseHandle(file->file);
+    }
+    
+    *file = {};
+}
+
+/*
+Network
+*/
+typedef SOCKET NetSocket;
+#define NET_INVALID_SOCKET INVALID_SOCKET
+
+static bool InitNetwork() {
+    WSADATA data;
+    int errorCode = WSAStartup(MAKEWORD(2, 2), &data);
+    if(errorCode != 0) {
+        printf("WSA error occured: %d\n", errorCode);
+        return false;
+    }
+    
+    return true;
+}
+
+static void FreeNetwork() {
+    WSACleanup();
+}
+
+static void CloseNetSocket(NetSocket netSocket) {
+    closesocket(netSocket);
+}
+
+//NOTE(ans): requests and results are small or sent in one piece, nagle would only delay them
+static void SetNoDelay(NetSocket netSocket) {
+    int noDelay = 1;
+    setsockopt(netSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&noDelay, sizeof(noDelay));
+}
+
+//NOTE(ans): recv on the socket fails once it waited that long for data, 0 waits forever
+static void SetReceiveTimeout(NetSocket netSocket, U32 timeoutMilliseconds) {
+    DWORD timeout = timeoutMilliseconds;
+    setsockopt(netSocket, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+}
+
+static NetSocket ListenTCP(U32 port) {
+    NetSocket result = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(result == NET_INVALID_SOCKET) {
+        printf("WSA error occured: %d\n", WSAGetLastError());
+        return NET_INVALID_SOCKET;
+    }
+    
+    int reuseAddress = 1;
+    setsockopt(result, SOL_SOCKET, SO_REUSEADDR, (char*)&reuseAddress, sizeof(reuseAddress));
+    
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((u_short)port);
+    
+    if(bind(result, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+       listen(result, SOMAXCONN) == SOCKET_ERROR) {
+        printf("WSA error occured: %d\n", WSAGetLastError());
+        closesocket(result);
+        return NET_INVALID_SOCKET;
+    }
+    
+    return result;
+}
+
+static NetSocket AcceptTCP(NetSocket listenSocket) {
+    NetSocket result = accept(listenSocket, NULL, NULL);
+    if(result != NET_INVALID_SOCKET) {
+        SetNoDelay(result);
+    }
+    
+    return result;
+}
+
+static NetSocket ConnectTCP(char* host, U32 port) {
+    char portName[16];
+    sprintf(portName, "%lu", port);
+    
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    
+    addrinfo* addresses;
+    if(getaddrinfo(host, portName, &hints, &addresses) != 0) {
+        printf("WSA error occured: %d\n", WSAGetLastError());
+        return NET_INVALID_SOCKET;
+    }
+    
+    NetSocket result = NET_INVALID_SOCKET;
+    for(addrinfo* address = addresses; address; address = address->ai_next) {
+        result = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if(result == NET_INVALID_SOCKET) {
+            continue;
+        }
+        
+        if(connect(result, address->ai_addr, (int)address->ai_addrlen) == 0) {
+            break;
+        }
+        
+        closesocket(result);
+        result = NET_INVALID_SOCKET;
+    }
+    freeaddrinfo(addresses);
+    
+    if(result != NET_INVALID_SOCKET) {
+        SetNoDelay(result);
+    }
+    
+    return result;
+}
+
+//NOTE(ans): send and recv move at most INT_MAX bytes and may return after less, both loop until everything went through
+static bool SendAll(NetSocket netSocket, void* data, size_t size) {
+    char* bytes = (char*)data;
+    
+    while(size) {
+        int chunkSize = size > 0x40000000 ? 0x40000000 : (int)size;
+        int sent = send(netSocket, bytes, chunkSize, 0);
+        if(sent <= 0) {
+            return false;
+        }
+        
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    
+    return true;
+}
+
+//NOTE(ans): false when the connection closed or failed before size bytes arrived
+static bool ReceiveAll(NetSocket netSocket, void* data, size_t size) {
+    char* bytes = (char*)data;
+    
+    while(size) {
+        int chunkSize = size > 0x40000000 ? 0x40000000 : (int)size;
+        int received = recv(netSocket, bytes, chunkSize, 0);
+        if(received <= 0) {
+            return false;
+        }
+        
+        bytes += received;
+        size -= (size_t)received;
+    }
+    
+    return true;
+}
+
+//NOTE(ans): 
+// waits up to timeoutMilliseconds until one of the sockets has data or a connection to accept,
+// readable gets set for every socket. returns the number of readable sockets
+static U32 WaitForSockets(NetSocket* sockets, U32 socketCount, bool* readable, U32 timeoutMilliseconds) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    
+    NetSocket highestSocket = 0;
+    for(U32 socketIndex = 0; socketIndex < socketCount; ++socketIndex) {
+        FD_SET(sockets[socketIndex], &readSet);
+        
+        if(sockets[socketIndex] > highestSocket) {
+            highestSocket = sockets[socketIndex];
+        }
+    }
+    
+    timeval timeout;
+    timeout.tv_sec = (long)(timeoutMilliseconds / 1000);
+    timeout.tv_usec = (long)((timeoutMilliseconds % 1000) * 1000);
+    
+    //NOTE(ans): windows ignores the first argument, it is only there for berkeley sockets
+    int readyCount = select((int)(highestSocket + 1), &readSet, NULL, NULL, &timeout);
+    if(readyCount == SOCKET_ERROR) {
+        printf("WSA error occured: %d\n", WSAGetLastError());
+        readyCount = 0;
+    }
+    
+    for(U32 socketIndex = 0; socketIndex < socketCount; ++socketIndex) {
+        readable[socketIndex] = FD_ISSET(sockets[socketIndex], &readSet) != 0;
+    }
+    
+    return (U32)readyCount;
 }
@@ -0,0 +1,421 @@
+static U64 AlignSceneOffset(U64 offset) {
+    U64 result = (offset + SCENE_FILE_ALIGNMENT - 1) & ~(U64)(SCENE_FILE_ALIGNMENT - 1);
+    
+    return result;
+}
+
+//NOTE(ans): returns 0 if the section does not fit the file or was written with a different layout
+static void* GetSceneSection(MappedFile* file, SceneFileSection section, U32 elementSize) {
+    if(section.elementSize != elementSize) {
+        return 0;
+    }
+    
+    if(section.offset % SCENE_FILE_ALIGNMENT) {
+        return 0;
+    }
+    
+    U64 sectionSize = (U64)section.count * (U64)elementSize;
+    if(section.offset > file->size || sectionSize > file->size - section.offset) {
+        return 0;
+    }
+    
+    void* result = (U8*)file->memory + section.offset;
+    
+    return result;
+}
+
+//NOTE(ans): 
+// every material index has to name a material and every node has to stay inside the node and sphere
+// arrays. children come after their parent like BuildBVH places them, so the tree has no cycles and
+// the depth found in one pass over the nodes bounds the traversal stacks
+static bool ValidateSceneIndices(World* world, U32 materialCount) {
+    for(U32 planeIndex = 0; planeIndex < world->planeCount; ++planeIndex) {
+        Plane plane = world->planes[planeIndex];
+        if(plane.matIndex >= materialCount || plane.secMatIndex >= materialCount) {
+            return false;
+        }
+    }
+    
+    for(U32 sphereIndex = 0; sphereIndex < world->sphereCount; ++sphereIndex) {
+        if(world->spheres[sphereIndex].matIndex >= materialCount) {
+            return false;
+        }
+    }
+    
+    U32 nodeCount = world->sphereNodeCount;
+    if(nodeCount == 0) {
+        return true;
+    }
+    
+    U8* nodeDepths = (U8*)malloc(nodeCount);
+    for(U32 nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex) {
+        nodeDepths[nodeIndex] = 0;
+    }
+    
+    bool result = true;
+    for(U32 nodeIndex = 0; nodeIndex < nodeCount && result; ++nodeIndex) {
+        BVHNode node = world->sphereNodes[nodeIndex];
+        
+        if(node.count) {
+            result = (U64)node.firstIndex + (U64)node.count <= (U64)world->sphereCount;
+        } else {
+            result = node.firstIndex > nodeIndex && (U64)node.firstIndex + 1 < (U64)nodeCount &&
+                nodeDepths[nodeIndex] + 1 < BVH_MAX_DEPTH;
+            
+            if(result) {
+                U8 childDepth = (U8)(nodeDepths[nodeIndex] + 1);
+                for(U32 childIndex = node.firstIndex; childIndex <= node.firstIndex + 1; ++childIndex) {
+                    if(nodeDepths[childIndex] < childDepth) {
+                        nodeDepths[childIndex] = childDepth;
+                    }
+                }
+            }
+        }
+    }
+    
+    free(nodeDepths);
+    
+    return result;
+}
+
+static bool LoadScene(char* fileName, Scene* scene) {
+    *scene = {};
+    
+    MappedFile file;
+    if(!MapFileReadOnly(fileName, &file)) {
+        fprintf(stderr, "Not able to open scene file %s . . .\n", fileName);
+        return false;
+    }
+    
+    SceneFileHeader* header = (SceneFileHeader*)file.memory;
+    if(file.size < sizeof(SceneFileHeader) ||
+       header->magic != SCENE_FILE_MAGIC ||
+       header->version != SCENE_FILE_VERSION ||
+       header->laneWidth != LANE_WIDTH) {
+        fprintf(stderr, "%s is not a scene file of version %d . . .\n", fileName, SCENE_FILE_VERSION);
+        UnmapFile(&file);
+        return false;
+    }
+    
+    World world = {};
+    world.materials = (Material*)GetSceneSection(&file, header->materials, sizeof(Material));
+    world.planes = (Plane*)GetSceneSection(&file, header->planes, sizeof(Plane));
+    world.planeCount = header->planes.count;
+    world.spheres = (Sphere*)GetSceneSection(&file, header->spheres, sizeof(Sphere));
+    world.sphereCount = header->spheres.count;
+    world.lights = (Light*)GetSceneSection(&file, header->lights, sizeof(Light));
+    world.lightCount = header->lights.count;
+    world.sphereNodes = (BVHNode*)GetSceneSection(&file, header->sphereNodes, sizeof(BVHNode));
+    world.sphereNodeCount = header->sphereNodes.count;
+    
+    F32** sphereLanes[] = {
+        &world.sphereLanes.x, &world.sphereLanes.y, &world.sphereLanes.z, &world.sphereLanes.radiusSquared
+    };
+    F32** planeLanes[] = {
+        &world.planeLanes.nx, &world.planeLanes.ny, &world.planeLanes.nz, &world.planeLanes.d
+    };
+    
+    bool valid = world.materials && world.planes && world.spheres && world.lights && world.sphereNodes;
+    for(U32 laneIndex = 0; laneIndex < 4; ++laneIndex) {
+        SceneFileSection sphereSection = header->sphereLanes[laneIndex];
+        SceneFileSection planeSection = header->planeLanes[laneIndex];
+        
+        *sphereLanes[laneIndex] = (F32*)GetSceneSection(&file, sphereSection, sizeof(F32));
+        *planeLanes[laneIndex] = (F32*)GetSceneSection(&file, planeSection, sizeof(F32));
+        
+        //NOTE(ans): the kernels always load full lanes, so the padding has to be there
+        valid = valid && *sphereLanes[laneIndex] && *planeLanes[laneIndex] &&
+            sphereSection.count == world.sphereCount + LANE_WIDTH &&
+            planeSection.count == world.planeCount + LANE_WIDTH;
+    }
+    
+    valid = valid && world.lightCount &&
+        (world.sphereCount ? world.sphereNodeCount != 0 : world.sphereNodeCount == 0) &&
+        ValidateSceneIndices(&world, header->materials.count);
+    
+    if(!valid) {
+        fprintf(stderr, "%s is damaged . . .\n", fileName);
+        UnmapFile(&file);
+        return false;
+    }
+    
+    scene->world = world;
+    scene->cameraP = header->cameraP;
+    scene->file = file;
+    
+    return true;
+}
+
+static void FreeScene(Scene* scene) {
+    UnmapFile(&scene->file);
+    
+    *scene = {};
+}
+
+static bool WriteSceneSection(FILE* file, U64* fileOffset, void* data, U32 count, U32 elementSize) {
+    U8 padding[SCENE_FILE_ALIGNMENT] = {};
+    
+    U64 alignedOffset = AlignSceneOffset(*fileOffset);
+    U32 paddingSize = (U32)(alignedOffset - *fileOffset);
+    if(paddingSize && fwrite(padding, paddingSize, 1, file) != 1) {
+        return false;
+    }
+    
+    U64 sectionSize = (U64)count * (U64)elementSize;
+    if(sectionSize && fwrite(data, (size_t)sectionSize, 1, file) != 1) {
+        return false;
+    }
+    
+    *fileOffset = alignedOffset + sectionSize;
+    
+    return true;
+}
+
+static SceneFileSection PlaceSceneSection(U64* fileOffset, U32 count, U32 elementSize) {
+    SceneFileSection result;
+    result.offset = AlignSceneOffset(*fileOffset);
+    result.count = count;
+    result.elementSize = elementSize;
+    
+    *fileOffset = result.offset + (U64)count * (U64)elementSize;
+    
+    return result;
+}
+
+//NOTE(ans): 
+// world needs its acceleration built, the sections are written in the order of the header.
+// World has no material count, so it is passed in
+static bool WriteSceneFile(char* fileName, World* world, U32 materialCount, V3 cameraP) {
+    U32 paddedSphereCount = world->sphereCount + LANE_WIDTH;
+    U32 paddedPlaneCount = world->planeCount + LANE_WIDTH;
+    
+    F32* sphereLanes[] = {
+        world->sphereLanes.x, world->sphereLanes.y, world->sphereLanes.z, world->sphereLanes.radiusSquared
+    };
+    F32* planeLanes[] = {
+        world->planeLanes.nx, world->planeLanes.ny, world->planeLanes.nz, world->planeLanes.d
+    };
+    
+    SceneFileHeader header = {};
+    header.magic = SCENE_FILE_MAGIC;
+    header.version = SCENE_FILE_VERSION;
+    header.laneWidth = LANE_WIDTH;
+    header.cameraP = cameraP;
+    
+    U64 fileOffset = sizeof(SceneFileHeader);
+    header.materials = PlaceSceneSection(&fileOffset, materialCount, sizeof(Material));
+    header.planes = PlaceSceneSection(&fileOffset, world->planeCount, sizeof(Plane));
+    header.spheres = PlaceSceneSection(&fileOffset, world->sphereCount, sizeof(Sphere));
+    header.lights = PlaceSceneSection(&fileOffset, world->lightCount, sizeof(Light));
+    header.sphereNodes = PlaceSceneSection(&fileOffset, world->sphereNodeCount, sizeof(BVHNode));
+    for(U32 laneIndex = 0; laneIndex < 4; ++laneIndex) {
+        header.sphereLanes[laneIndex] = PlaceSceneSection(&fileOffset, paddedSphereCount, sizeof(F32));
+    }
+    for(U32 laneIndex = 0; laneIndex < 4; ++laneIndex) {
+        header.planeLanes[laneIndex] = PlaceSceneSection(&fileOffset, paddedPlaneCount, sizeof(F32));
+    }
+    
+    FILE* file = fopen(fileName, "wb");
+    if(!file) {
+        fprintf(stderr, "Not able to open scene file %s for writing . . .\n", fileName);
+        return false;
+    }
+    
+    U64 writeOffset = 0;
+    bool written = WriteSceneSection(file, &writeOffset, &header, 1, sizeof(SceneFileHeader));
+    written = written && WriteSceneSection(file, &writeOffset, world->materials, materialCount, sizeof(Material));
+    written = written && WriteSceneSection(file, &writeOffset, world->planes, world->planeCount, sizeof(Plane));
+    written = written && WriteSceneSection(file, &writeOffset, world->spheres, world->sphereCount, sizeof(Sphere));
+    written = written && WriteSceneSection(file, &writeOffset, world->lights, world->lightCount, sizeof(Light));
+    written = written && WriteSceneSection(file, &writeOffset, world->sphereNodes, world->sphereNodeCount, sizeof(BVHNode));
+    for(U32 laneIndex = 0; laneIndex < 4; ++laneIndex) {
+        written = written && WriteSceneSection(file, &writeOffset, sphereLanes[laneIndex], paddedSphereCount, sizeof(F32));
+    }
+    for(U32 laneIndex = 0; laneIndex < 4; ++laneIndex) {
+        written = written && WriteSceneSection(file, &writeOffset, planeLanes[laneIndex], paddedPlaneCount, sizeof(F32));
+    }
+    
+    fclose(file);
+    
+    if(!written) {
+        fprintf(stderr, "Not able to write scene file %s . . .\n", fileName);
+    }
+    
+    return written;
+}
+
+//NOTE(ans): doubles the capacity when count reached it
+static void* GrowSceneArray(void* array, U32 count, U32* capacity, U32 elementSize) {
+    if(count < *capacity) {
+        return array;
+    }
+    
+    U32 newCapacity = *capacity ? *capacity * 2 : 64;
+    void* result = malloc((size_t)newCapacity * elementSize);
+    if(array) {
+        memcpy(result, array, (size_t)count * elementSize);
+        free(array);
+    }
+    
+    *capacity = newCapacity;
+    
+    return result;
+}
+
+//NOTE(ans): reads the text format described in ray_scene.h, builds the acceleration and writes the binary scene
+static bool ConvertSceneText(char* textFileName, char* sceneFileName) {
+    FILE* textFile = fopen(textFileName, "r");
+    if(!textFile) {
+        fprintf(stderr, "Not able to open scene text %s . . .\n", textFileName);
+        return false;
+    }
+    
+    V3 cameraP = {0, -20, 5};
+    
+    Material* materials = 0;
+    U32 materialCount = 0;
+    U32 materialCapacity = 0;
+    
+    Plane* planes = 0;
+    U32 planeCount = 0;
+    U32 planeCapacity = 0;
+    
+    Sphere* spheres = 0;
+    U32 sphereCount = 0;
+    U32 sphereCapacity = 0;
+    
+    Light* lights = 0;
+    U32 lightCount = 0;
+    U32 lightCapacity = 0;
+    
+    bool valid = true;
+    U32 lineNumber = 0;
+    char line[512];
+    while(valid && fgets(line, sizeof(line), textFile)) {
+        ++lineNumber;
+        
+        char keyword[32];
+        if(sscanf(line, "%31s", keyword) != 1 || keyword[0] == '#') {
+            continue;
+        }
+        
+        //NOTE(ans): sscanf reads unsigned int, U32 is not the same type on every platform
+        unsigned int matIndex, secMatIndex;
+        char lightType[32];
+        
+        if(strcmp(keyword, "camera") == 0) {
+            valid = sscanf(line, "%*s %f %f %f", &cameraP.x, &cameraP.y, &cameraP.z) == 3;
+        } else if(strcmp(keyword, "material") == 0) {
+            materials = (Material*)GrowSceneArray(materials, materialCount, &materialCapacity, sizeof(Material));
+            
+            Material* material = materials + materialCount++;
+            valid = sscanf(line, "%*s %f %f %f %f %f",
+                           &material->color.r, &material->color.g, &material->color.b,
+                           &material->reflection, &material->absorbtion) == 5;
+        } else if(strcmp(keyword, "plane") == 0) {
+            planes = (Plane*)GrowSceneArray(planes, planeCount, &planeCapacity, sizeof(Plane));
+            
+            Plane* plane = planes + planeCount++;
+            valid = sscanf(line, "%*s %f %f %f %f %f %f %u %u",
+                           &plane->n.x, &plane->n.y, &plane->n.z,
+                           &plane->p.x, &plane->p.y, &plane->p.z,
+                           &matIndex, &secMatIndex) == 8;
+            plane->matIndex = matIndex;
+            plane->secMatIndex = secMatIndex;
+        } else if(strcmp(keyword, "sphere") == 0) {
+            spheres = (Sphere*)GrowSceneArray(spheres, sphereCount, &sphereCapacity, sizeof(Sphere));
+            
+            Sphere* sphere = spheres + sphereCount++;
+            valid = sscanf(line, "%*s %f %f %f %f %u",
+                           &sphere->p.x, &sphere->p.y, &sphere->p.z,
+                           &sphere->r, &matIndex) == 5;
+            sphere->matIndex = matIndex;
+        } else if(strcmp(keyword, "light") == 0) {
+            lights = (Light*)GrowSceneArray(lights, lightCount, &lightCapacity, sizeof(Light));
+            
+            Light* light = lights + lightCount++;
+            V3 vector;
+            valid = sscanf(line, "%*s %31s %f %f %f %f %f %f %f", lightType,
+                           &light->color.r, &light->color.g, &light->color.b,
+                           &light->intensity,
+                           &vector.x, &vector.y, &vector.z) == 8;
+            
+            if(strcmp(lightType, "directional") == 0) {
+                light->type = LightType_Directional;
+                light->d.invertedDirection = vector;
+            } else if(strcmp(lightType, "point") == 0) {
+                light->type = LightType_Point;
+                light->p.origin = vector;
+            } else {
+                valid = false;
+            }
+        } else {
+            valid = false;
+        }
+    }
+    
+    fclose(textFile);
+    
+    if(!valid) {
+        fprintf(stderr, "%s line %lu can not be read . . .\n", textFileName, (unsigned long)lineNumber);
+    } else if(!materialCount || !lightCount) {
+        //NOTE(ans): material 0 is the sky, it has to exist even without any object
+        fprintf(stderr, "%s needs at least one material and one light . . .\n", textFileName);
+        valid = false;
+    }
+    
+    for(U32 planeIndex = 0; valid && planeIndex < planeCount; ++planeIndex) {
+        planes[planeIndex].id = planeIndex;
+        valid = planes[planeIndex].matIndex < materialCount && planes[planeIndex].secMatIndex < materialCount;
+        
+        if(!valid) {
+            fprintf(stderr, "%s uses a material that does not exist . . .\n", textFileName);
+        }
+    }
+    
+    for(U32 sphereIndex = 0; valid && sphereIndex < sphereCount; ++sphereIndex) {
+        spheres[sphereIndex].id = planeCount + sphereIndex;
+        valid = spheres[sphereIndex].matIndex < materialCount;
+        
+        if(!valid) {
+            fprintf(stderr, "%s uses a material that does not exist . . .\n", textFileName);
+        }
+    }
+    
+    if(valid) {
+        World world = {};
+        world.materials = materials;
+        world.planes = planes;
+        world.planeCount = planeCount;
+        world.spheres = spheres;
+        world.sphereCount = sphereCount;
+        world.lights = lights;
+        world.lightCount = lightCount;
+        
+        BuildWorldAcceleration(&world);
+        
+        valid = WriteSceneFile(sceneFileName, &world, materialCount, cameraP);
+        
+        if(valid) {
+            printf("Wrote %s with %lu spheres and %lu planes\n", sceneFileName,
+                   (unsigned long)sphereCount, (unsigned long)planeCount);
+        }
+        
+        free(world.sphereNodes);
+        free(world.sphereLanes.x);
+        free(world.sphereLanes.y);
+        free(world.sphereLanes.z);
+        free(world.sphereLanes.radiusSquared);
+        free(world.planeLanes.nx);
+        free(world.planeLanes.ny);
+        free(world.planeLanes.nz);
+        free(world.planeLanes.d);
+    }
+    
+    free(materials);
+    free(planes);
+    free(spheres);
+    free(lights);
+    
+    return valid;
+}
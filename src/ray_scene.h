@@ -0,0 +1,59 @@
+/*
+Scene File
+
+binary scene with everything World needs, including the bvh and the lane arrays.
+the file gets mapped and World points straight into it, loading does not copy or parse anything.
+written by ConvertSceneText from the text format below.
+
+text format, one element per line, # starts a comment:
+camera    x y z
+material  r g b reflection absorbtion
+plane     nx ny nz  px py pz  matIndex secMatIndex
+sphere    x y z  radius  matIndex
+light     directional  r g b  intensity  dx dy dz
+light     point        r g b  intensity  x y z
+
+ids are given in file order, planes first and spheres after them
+*/
+
+#define SCENE_FILE_MAGIC 0x4E435352
+#define SCENE_FILE_VERSION 1
+
+//NOTE(ans): every section starts on a cache line
+#define SCENE_FILE_ALIGNMENT 64
+
+//NOTE(ans): elementSize catches files written by a build with different struct layouts
+struct SceneFileSection {
+    U64 offset;
+    U32 count;
+    U32 elementSize;
+};
+
+struct SceneFileHeader {
+    U32 magic;
+    U32 version;
+    U32 laneWidth;
+    U32 reserved;
+    
+    SceneFileSection materials;
+    SceneFileSection planes;
+    SceneFileSection spheres;
+    SceneFileSection lights;
+    
+    //NOTE(ans): spheres are stored in bvh leaf order
+    SceneFileSection sphereNodes;
+    
+    //NOTE(ans): x, y, z, radiusSquared and nx, ny, nz, d, all padded by laneWidth
+    SceneFileSection sphereLanes[4];
+    SceneFileSection planeLanes[4];
+    
+    V3 cameraP;
+    U32 reserved2;
+};
+
+struct Scene {
+    World world;
+    V3 cameraP;
+    
+    MappedFile file;
+};
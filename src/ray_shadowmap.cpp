@@ -0,0 +1,238 @@
+struct ShadowMapJob {
+    RenderContext* context;
+    World* sphereWorld;
+};
+
+//NOTE(ans): every thread takes every threadCount-th row of every map
+static void ShadowMapThreadJob(void* jobData, U32 threadIndex) {
+    ShadowMapJob* job = (ShadowMapJob*)jobData;
+    RenderContext* context = job->context;
+    World* sphereWorld = job->sphereWorld;
+    
+    //NOTE(ans): the box and object tests of the map rays would skew the tests per ray of the render
+    RayTraceStats buildStats = {};
+    U64 rayCount = 0;
+    
+    for(U32 lightIndex = 0; lightIndex < sphereWorld->lightCount; ++lightIndex) {
+        ShadowMap* map = context->shadowMaps + lightIndex;
+        if(!map->size) {
+            continue;
+        }
+        
+        V3 rayDirection = map->lightDirection * -1.0f;
+        
+        for(U32 y = threadIndex; y < map->size; y += context->threadCount) {
+            ShadowMapTexel* row = map->texels + (size_t)y * map->size;
+            V3 rowOrigin = map->axisV * (map->minV + ((F32)y + 0.5f) * map->texelSize) +
+                map->lightDirection * map->startDepth;
+            
+            for(U32 x = 0; x < map->size; ++x) {
+                V3 rayOrigin = rowOrigin + map->axisU * (map->minU + ((F32)x + 0.5f) * map->texelSize);
+                
+                ShootRayResult result = {};
+                RayTraceObjects(rayOrigin, rayDirection,
+                                sphereWorld,
+                                F32_MAX,
+                                &result,
+                                &buildStats);
+                
+                ShadowMapTexel texel;
+                texel.depth = F32_MAX;
+                texel.objectId = U32_MAX;
+                if(result.hit) {
+                    texel.depth = map->startDepth - Inner(result.hitPoint, map->lightDirection);
+                    texel.objectId = result.hitId;
+                }
+                
+                row[x] = texel;
+            }
+            
+            rayCount += map->size;
+        }
+    }
+    
+    context->threadData[threadIndex].stats.shadowMapRayCount += rayCount;
+}
+
+//NOTE(ans):
+// size x size texels for every directional light, after PrepareRender. the maps only hold spheres,
+// a world without spheres or a light without directional type gets no map
+static void BuildShadowMaps(RenderContext* context, World* world, U32 size) {
+    if(size < SHADOW_MAP_MIN_SIZE) {
+        size = SHADOW_MAP_MIN_SIZE;
+    } else if(size > SHADOW_MAP_MAX_SIZE) {
+        size = SHADOW_MAP_MAX_SIZE;
+    }
+    
+    if(world->lightCount > context->shadowMapCapacity) {
+        FreeShadowMaps(context);
+        
+        context->shadowMaps = (ShadowMap*)malloc(sizeof(ShadowMap) * world->lightCount);
+        for(U32 lightIndex = 0; lightIndex < world->lightCount; ++lightIndex) {
+            context->shadowMaps[lightIndex] = {};
+        }
+        context->shadowMapCapacity = world->lightCount;
+    }
+    
+    bool anyMap = false;
+    for(U32 lightIndex = 0; lightIndex < world->lightCount; ++lightIndex) {
+        ShadowMap* map = context->shadowMaps + lightIndex;
+        Light light = world->lights[lightIndex];
+        
+        map->size = 0;
+        if(light.type != LightType_Directional || world->sphereCount == 0) {
+            continue;
+        }
+        
+        V3 lightDirection = Normalize(light.d.invertedDirection);
+        V3 up = {0, 0, 1};
+        if(lightDirection.z > 0.9f || lightDirection.z < -0.9f) {
+            up = {1, 0, 0};
+        }
+        
+        V3 axisU = Normalize(Cross(lightDirection, up));
+        V3 axisV = Cross(lightDirection, axisU);
+        
+        F32 minU = F32_MAX;
+        F32 minV = F32_MAX;
+        F32 maxU = -F32_MAX;
+        F32 maxV = -F32_MAX;
+        F32 maxDepth = -F32_MAX;
+        for(U32 sphereIndex = 0; sphereIndex < world->sphereCount; ++sphereIndex) {
+            Sphere sphere = world->spheres[sphereIndex];
+            
+            F32 u = Inner(sphere.p, axisU);
+            F32 v = Inner(sphere.p, axisV);
+            F32 depth = Inner(sphere.p, lightDirection);
+            
+            minU = Min(minU, u - sphere.r);
+            minV = Min(minV, v - sphere.r);
+            maxU = Max(maxU, u + sphere.r);
+            maxV = Max(maxV, v + sphere.r);
+            maxDepth = Max(maxDepth, depth + sphere.r);
+        }
+        
+        F32 extent = Max(maxU - minU, maxV - minV);
+        F32 texelSize = extent / (F32)(size - 2 * SHADOW_MAP_BORDER);
+        
+        map->size = size;
+        map->lightDirection = lightDirection;
+        map->axisU = axisU;
+        map->axisV = axisV;
+        map->minU = minU - SHADOW_MAP_BORDER * texelSize;
+        map->minV = minV - SHADOW_MAP_BORDER * texelSize;
+        map->texelSize = texelSize;
+        map->startDepth = maxDepth + 1.0f;
+        
+        //NOTE(ans): same tolerance as RayTraceOcclusion plus the depth a sphere can change over two texels
+        map->depthBias = 0.01f + 2 * texelSize;
+        
+        U64 texelCount = (U64)size * (U64)size;
+        if(texelCount > map->texelCapacity) {
+            free(map->texels);
+            map->texels = (ShadowMapTexel*)malloc(sizeof(ShadowMapTexel) * (size_t)texelCount);
+            map->texelCapacity = texelCount;
+        }
+        
+        anyMap = true;
+    }
+    
+    for(U32 lightIndex = world->lightCount; lightIndex < context->shadowMapCapacity; ++lightIndex) {
+        context->shadowMaps[lightIndex].size = 0;
+    }
+    
+    if(!anyMap) {
+        return;
+    }
+    
+    World sphereWorld = *world;
+    sphereWorld.planeCount = 0;
+    
+    ShadowMapJob job;
+    job.context = context;
+    job.sphereWorld = &sphereWorld;
+    
+    RunThreadPool(context->threadPool, ShadowMapThreadJob, &job);
+}
+
+static void FreeShadowMaps(RenderContext* context) {
+    for(U32 lightIndex = 0; lightIndex < context->shadowMapCapacity; ++lightIndex) {
+        free(context->shadowMaps[lightIndex].texels);
+    }
+    free(context->shadowMaps);
+    
+    context->shadowMaps = 0;
+    context->shadowMapCapacity = 0;
+}
+
+//NOTE(ans):
+// visibility of a light sample at point towards the light of the map. the 3x3 texels around the
+// point have to agree, otherwise the sample sits on a silhouette the texels cannot resolve.
+// a texel of the shaded sphere itself only counts as lit when it is not in front of the point,
+// behind its own sphere a sample could still be blocked by a sphere inside the shadow of it
+static ShadowMapResult LookupShadowMap(ShadowMap* map, World* world, V3 point, U32 ignoreId) {
+    //NOTE(ans): same test as the planes of RayTraceOcclusion
+    F32 tolerance = 0.01f;
+    for(U32 planeIndex = 0; planeIndex < world->planeCount; ++planeIndex) {
+        Plane plane = world->planes[planeIndex];
+        if(plane.id == ignoreId) {
+            continue;
+        }
+        
+        F32 divisor = Inner(map->lightDirection, plane.n);
+        F32 t = (Inner(plane.p, plane.n) - Inner(point, plane.n)) / divisor;
+        
+        if((divisor < -tolerance || divisor > tolerance) && t > tolerance) {
+            return ShadowMapResult_Shadowed;
+        }
+    }
+    
+    F32 depth = map->startDepth - Inner(point, map->lightDirection);
+    F32 u = (Inner(point, map->axisU) - map->minU) / map->texelSize;
+    F32 v = (Inner(point, map->axisV) - map->minV) / map->texelSize;
+    
+    //NOTE(ans): the border keeps every sphere at least two texels away from the edge
+    F32 lastCenter = (F32)(map->size - 1);
+    if(u < 1 || v < 1 || u >= lastCenter || v >= lastCenter) {
+        return ShadowMapResult_Lit;
+    }
+    
+    U32 centerX = (U32)u;
+    U32 centerY = (U32)v;
+    
+    U32 litCount = 0;
+    U32 shadowedCount = 0;
+    for(U32 y = centerY - 1; y <= centerY + 1; ++y) {
+        ShadowMapTexel* row = map->texels + (size_t)y * map->size;
+        
+        for(U32 x = centerX - 1; x <= centerX + 1; ++x) {
+            ShadowMapTexel texel = row[x];
+            
+            bool inFront = texel.depth < depth - map->depthBias;
+            bool behind = texel.depth > depth + map->depthBias;
+            
+            if(texel.objectId == U32_MAX || behind) {
+                ++litCount;
+            } else if(texel.objectId == ignoreId) {
+                if(inFront) {
+                    return ShadowMapResult_Unknown;
+                }
+                
+                ++litCount;
+            } else if(inFront) {
+                ++shadowedCount;
+            } else {
+                return ShadowMapResult_Unknown;
+            }
+        }
+    }
+    
+    ShadowMapResult result = ShadowMapResult_Unknown;
+    if(litCount == 9) {
+        result = ShadowMapResult_Lit;
+    } else if(shadowedCount == 9) {
+        result = ShadowMapResult_Shadowed;
+    }
+    
+    return result;
+}
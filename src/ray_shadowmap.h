@@ -0,0 +1,50 @@
+/*
+Shadow Map
+
+every shadow ray of a directional light has the same direction, so every directional light gets an
+orthographic map of the spheres as seen from the light: depth and id of the first sphere per texel.
+a light sample only looks at the texels around it and traces its shadow ray when they disagree,
+near silhouettes and where the blocker is about as far from the light as the sample itself.
+planes are infinite and stay out of the map, samples test them directly.
+*/
+
+//NOTE(ans): the map of a light covers the spheres plus this many texels on every side
+#define SHADOW_MAP_BORDER 2
+
+//NOTE(ans): shadowMapSize gets clamped to these, the border needs at least one texel inside it
+#define SHADOW_MAP_MIN_SIZE (2 * SHADOW_MAP_BORDER + 1)
+#define SHADOW_MAP_MAX_SIZE 16384
+
+struct ShadowMapTexel {
+    F32 depth;
+    U32 objectId;
+};
+
+enum ShadowMapResult {
+    ShadowMapResult_Lit,
+    ShadowMapResult_Shadowed,
+    ShadowMapResult_Unknown
+};
+
+struct ShadowMap {
+    //NOTE(ans): 0 for lights without a map
+    U32 size;
+    
+    //NOTE(ans): lightDirection points to the light, depth is measured along -lightDirection from startDepth
+    V3 lightDirection;
+    V3 axisU;
+    V3 axisV;
+    F32 minU;
+    F32 minV;
+    F32 texelSize;
+    F32 startDepth;
+    F32 depthBias;
+    
+    ShadowMapTexel* texels;
+    U64 texelCapacity;
+};
+
+//NOTE(ans): defined in ray_shadowmap.cpp, which comes after ray_tracing.cpp
+static void BuildShadowMaps(RenderContext* context, World* world, U32 size);
+static void FreeShadowMaps(RenderContext* context);
+static ShadowMapResult LookupShadowMap(ShadowMap* map, World* world, V3 point, U32 ignoreId);
@@ -0,0 +1,165 @@
+/*
+8 wide float lanes
+
+With -arch:AVX2 every operation is one AVX instruction, without it the lanes are split in two
+SSE registers so the code using F32x8 does not have to care.
+*/
+#include <immintrin.h>
+
+#define LANE_WIDTH 8
+
+#if defined(__AVX2__) || defined(__AVX__)
+#define SIMD_AVX 1
+#else
+#define SIMD_AVX 0
+#endif
+
+struct F32x8 {
+#if SIMD_AVX
+    __m256 v;
+#else
+    __m128 lo;
+    __m128 hi;
+#endif
+};
+
+#if SIMD_AVX
+
+static inline F32x8 LoadF32x8(F32* values) {
+    F32x8 result;
+    result.v = _mm256_loadu_ps(values);
+    return result;
+}
+
+static inline F32x8 SetF32x8(F32 value) {
+    F32x8 result;
+    result.v = _mm256_set1_ps(value);
+    return result;
+}
+
+static inline F32x8 LaneIndexF32x8() {
+    F32x8 result;
+    result.v = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    return result;
+}
+
+static inline void StoreF32x8(F32* values, F32x8 a) {
+    _mm256_storeu_ps(values, a.v);
+}
+
+//NOTE(ans): lanes must be in the positive int range, the fraction gets cut off
+static inline void StoreTruncatedU32x8(U32* values, F32x8 a) {
+    _mm256_storeu_si256((__m256i*)values, _mm256_cvttps_epi32(a.v));
+}
+
+static inline F32x8 operator+(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_add_ps(a.v, b.v); return r; }
+static inline F32x8 operator-(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_sub_ps(a.v, b.v); return r; }
+static inline F32x8 operator*(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_mul_ps(a.v, b.v); return r; }
+static inline F32x8 operator/(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_div_ps(a.v, b.v); return r; }
+static inline F32x8 operator&(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_and_ps(a.v, b.v); return r; }
+static inline F32x8 operator|(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_or_ps(a.v, b.v); return r; }
+static inline F32x8 operator<(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); return r; }
+static inline F32x8 operator>(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); return r; }
+static inline F32x8 operator<=(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); return r; }
+static inline F32x8 operator>=(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); return r; }
+static inline F32x8 Min(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_min_ps(a.v, b.v); return r; }
+static inline F32x8 Max(F32x8 a, F32x8 b) { F32x8 r; r.v = _mm256_max_ps(a.v, b.v); return r; }
+static inline F32x8 SquareRoot(F32x8 a) { F32x8 r; r.v = _mm256_sqrt_ps(a.v); return r; }
+
+//NOTE(ans): picks b where the mask is set and a everywhere else
+static inline F32x8 Select(F32x8 a, F32x8 b, F32x8 mask) { F32x8 r; r.v = _mm256_blendv_ps(a.v, b.v, mask.v); return r; }
+static inline U32 MaskBits(F32x8 mask) { return (U32)_mm256_movemask_ps(mask.v); }
+
+#else
+
+static inline F32x8 LoadF32x8(F32* values) {
+    F32x8 result;
+    result.lo = _mm_loadu_ps(values);
+    result.hi = _mm_loadu_ps(values + 4);
+    return result;
+}
+
+static inline F32x8 SetF32x8(F32 value) {
+    F32x8 result;
+    result.lo = _mm_set1_ps(value);
+    result.hi = result.lo;
+    return result;
+}
+
+static inline F32x8 LaneIndexF32x8() {
+    F32x8 result;
+    result.lo = _mm_setr_ps(0, 1, 2, 3);
+    result.hi = _mm_setr_ps(4, 5, 6, 7);
+    return result;
+}
+
+static inline void StoreF32x8(F32* values, F32x8 a) {
+    _mm_storeu_ps(values, a.lo);
+    _mm_storeu_ps(values + 4, a.hi);
+}
+
+//NOTE(ans): lanes must be in the positive int range, the fraction gets cut off
+static inline void StoreTruncatedU32x8(U32* values, F32x8 a) {
+    _mm_storeu_si128((__m128i*)values, _mm_cvttps_epi32(a.lo));
+    _mm_storeu_si128((__m128i*)(values + 4), _mm_cvttps_epi32(a.hi));
+}
+
+#define SSE_LANE_OP(op, a, b) F32x8 r; r.lo = op(a.lo, b.lo); r.hi = op(a.hi, b.hi); return r;
+
+static inline F32x8 operator+(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_add_ps, a, b) }
+static inline F32x8 operator-(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_sub_ps, a, b) }
+static inline F32x8 operator*(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_mul_ps, a, b) }
+static inline F32x8 operator/(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_div_ps, a, b) }
+static inline F32x8 operator&(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_and_ps, a, b) }
+static inline F32x8 operator|(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_or_ps, a, b) }
+static inline F32x8 operator<(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_cmplt_ps, a, b) }
+static inline F32x8 operator>(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_cmpgt_ps, a, b) }
+static inline F32x8 operator<=(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_cmple_ps, a, b) }
+static inline F32x8 operator>=(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_cmpge_ps, a, b) }
+static inline F32x8 Min(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_min_ps, a, b) }
+static inline F32x8 Max(F32x8 a, F32x8 b) { SSE_LANE_OP(_mm_max_ps, a, b) }
+static inline F32x8 SquareRoot(F32x8 a) { F32x8 r; r.lo = _mm_sqrt_ps(a.lo); r.hi = _mm_sqrt_ps(a.hi); return r; }
+
+//NOTE(ans): picks b where the mask is set and a everywhere else
+static inline F32x8 Select(F32x8 a, F32x8 b, F32x8 mask) {
+    F32x8 r;
+    r.lo = _mm_or_ps(_mm_andnot_ps(mask.lo, a.lo), _mm_and_ps(mask.lo, b.lo));
+    r.hi = _mm_or_ps(_mm_andnot_ps(mask.hi, a.hi), _mm_and_ps(mask.hi, b.hi));
+    return r;
+}
+
+static inline U32 MaskBits(F32x8 mask) {
+    return (U32)(_mm_movemask_ps(mask.lo) | (_mm_movemask_ps(mask.hi) << 4));
+}
+
+#undef SSE_LANE_OP
+
+#endif
+
+//NOTE(ans): returns the index of the smallest lane, ties go to the lower lane
+static inline U32 MinLane(F32x8 a, F32* minValue) {
+    F32 values[LANE_WIDTH];
+    StoreF32x8(values, a);
+    
+    U32 result = 0;
+    for(U32 lane = 1; lane < LANE_WIDTH; ++lane) {
+        if(values[lane] < values[result]) {
+            result = lane;
+        }
+    }
+    
+    *minValue = values[result];
+    
+    return result;
+}
+
+//NOTE(ans): index of the lowest set bit, bits must not be 0
+static inline U32 FirstBit(U32 bits) {
+    U32 result = 0;
+    
+    while(!(bits & (1 << result))) {
+        ++result;
+    }
+    
+    return result;
+}
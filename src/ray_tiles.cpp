@@ -0,0 +1,204 @@
+static inline U32 SpreadBits(U32 v) {
+    //NOTE(ans): inserts a zero bit between each of the lower 16 bits
+    v &= 0x0000FFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    
+    return v;
+}
+
+static inline U32 EncodeMorton2(U32 x, U32 y) {
+    U32 result;
+    
+    result = SpreadBits(x) | (SpreadBits(y) << 1);
+    
+    return result;
+}
+
+struct MortonTile {
+    U32 code;
+    RenderTile tile;
+};
+
+static int CompareMortonTiles(const void* a, const void* b) {
+    U32 codeA = ((MortonTile*)a)->code;
+    U32 codeB = ((MortonTile*)b)->code;
+    
+    int result = (codeA > codeB) - (codeA < codeB);
+    
+    return result;
+}
+
+static inline U64 PackTileRange(U32 head, U32 tail) {
+    return ((U64)tail << 32) | (U64)head;
+}
+
+static void InitTileScheduler(TileScheduler* scheduler, U32 queueCount) {
+    scheduler->tiles = 0;
+    scheduler->tileCount = 0;
+    scheduler->tileCapacity = 0;
+    scheduler->imageWidth = 0;
+    scheduler->regionY = 0;
+    scheduler->regionHeight = 0;
+    scheduler->tileSize = 0;
+    
+    scheduler->queues = (TileQueue*)malloc(sizeof(TileQueue) * queueCount);
+    scheduler->queueCount = queueCount;
+}
+
+static void BuildTiles(TileScheduler* scheduler,
+                       U32 imageWidth, U32 regionY, U32 regionHeight,
+                       U32 tileSize) {
+    U32 tilesX = (imageWidth + tileSize - 1) / tileSize;
+    U32 tilesY = (regionHeight + tileSize - 1) / tileSize;
+    U32 tileCount = tilesX * tilesY;
+    
+    MortonTile* mortonTiles = (MortonTile*)malloc(sizeof(MortonTile) * tileCount);
+    for(U32 tileY = 0; tileY < tilesY; ++tileY) {
+        for(U32 tileX = 0; tileX < tilesX; ++tileX) {
+            MortonTile* mortonTile = mortonTiles + (tileY * tilesX + tileX);
+            
+            RenderTile tile;
+            tile.x = tileX * tileSize;
+            tile.y = regionY + tileY * tileSize;
+            
+            //NOTE(ans): tiles at the right and top border get cut to the region size
+            tile.width = imageWidth - tile.x;
+            if(tile.width > tileSize) {
+                tile.width = tileSize;
+            }
+            
+            tile.height = regionHeight - tileY * tileSize;
+            if(tile.height > tileSize) {
+                tile.height = tileSize;
+            }
+            
+            mortonTile->code = EncodeMorton2(tileX, tileY);
+            mortonTile->tile = tile;
+        }
+    }
+    
+    //NOTE(ans):
+    // walking tiles in morton order keeps the tiles of one queue close together on the image,
+    // so a thread mostly touches the same objects and the same parts of the framebuffer
+    qsort(mortonTiles, tileCount, sizeof(MortonTile), CompareMortonTiles);
+    
+    if(tileCount > scheduler->tileCapacity) {
+        free(scheduler->tiles);
+        scheduler->tiles = (RenderTile*)malloc(sizeof(RenderTile) * tileCount);
+        scheduler->tileCapacity = tileCount;
+    }
+    
+    for(U32 tileIndex = 0; tileIndex < tileCount; ++tileIndex) {
+        scheduler->tiles[tileIndex] = mortonTiles[tileIndex].tile;
+    }
+    free(mortonTiles);
+    
+    scheduler->tileCount = tileCount;
+    scheduler->imageWidth = imageWidth;
+    scheduler->regionY = regionY;
+    scheduler->regionHeight = regionHeight;
+    scheduler->tileSize = tileSize;
+}
+
+//NOTE(ans): 
+// called before every render, only touches memory when the layout changed.
+// the region covers the rows regionY to regionY + regionHeight over the full image width
+static void ResetTileSchedulerRegion(TileScheduler* scheduler,
+                                     U32 imageWidth, U32 regionY, U32 regionHeight,
+                                     U32 tileSize) {
+    if(scheduler->imageWidth != imageWidth ||
+       scheduler->regionY != regionY ||
+       scheduler->regionHeight != regionHeight ||
+       scheduler->tileSize != tileSize) {
+        BuildTiles(scheduler, imageWidth, regionY, regionHeight, tileSize);
+    }
+    
+    //NOTE(ans): every queue starts with a contiguous chunk of the morton ordered tiles
+    U32 tileCount = scheduler->tileCount;
+    U32 queueCount = scheduler->queueCount;
+    for(U32 queueIndex = 0; queueIndex < queueCount; ++queueIndex) {
+        U32 head = (U32)(((U64)tileCount * queueIndex) / queueCount);
+        U32 tail = (U32)(((U64)tileCount * (queueIndex + 1)) / queueCount);
+        
+        scheduler->queues[queueIndex].range = PackTileRange(head, tail);
+    }
+}
+
+static void ResetTileScheduler(TileScheduler* scheduler,
+                               U32 imageWidth, U32 imageHeight,
+                               U32 tileSize) {
+    ResetTileSchedulerRegion(scheduler, imageWidth, 0, imageHeight, tileSize);
+}
+
+static void FreeTileScheduler(TileScheduler* scheduler) {
+    free(scheduler->tiles);
+    free(scheduler->queues);
+    
+    scheduler->tiles = 0;
+    scheduler->tileCount = 0;
+    scheduler->tileCapacity = 0;
+    scheduler->queues = 0;
+    scheduler->queueCount = 0;
+}
+
+//NOTE(ans): the owner takes tiles from the front to stay in morton order
+static bool PopTile(TileScheduler* scheduler, U32 queueIndex, RenderTile* tile) {
+    TileQueue* queue = scheduler->queues + queueIndex;
+    
+    for(;;) {
+        U64 range = queue->range;
+        U32 head = (U32)range;
+        U32 tail = (U32)(range >> 32);
+        
+        if(head >= tail) {
+            return false;
+        }
+        
+        U64 newRange = PackTileRange(head + 1, tail);
+        if(AtomicCompareExchangeU64(&queue->range, newRange, range) == range) {
+            *tile = scheduler->tiles[head];
+            return true;
+        }
+    }
+}
+
+//NOTE(ans): thieves take tiles from the back, which is the part the owner would reach last
+static bool StealTile(TileScheduler* scheduler, U32 queueIndex, RenderTile* tile) {
+    TileQueue* queue = scheduler->queues + queueIndex;
+    
+    for(;;) {
+        U64 range = queue->range;
+        U32 head = (U32)range;
+        U32 tail = (U32)(range >> 32);
+        
+        if(head >= tail) {
+            return false;
+        }
+        
+        U64 newRange = PackTileRange(head, tail - 1);
+        if(AtomicCompareExchangeU64(&queue->range, newRange, range) == range) {
+            *tile = scheduler->tiles[tail - 1];
+            return true;
+        }
+    }
+}
+
+static bool NextTile(TileScheduler* scheduler, U32 queueIndex, RenderTile* tile) {
+    if(PopTile(scheduler, queueIndex, tile)) {
+        return true;
+    }
+    
+    U32 queueCount = scheduler->queueCount;
+    for(U32 offset = 1; offset < queueCount; ++offset) {
+        U32 victimIndex = (queueIndex + offset) % queueCount;
+        
+        if(StealTile(scheduler, victimIndex, tile)) {
+            return true;
+        }
+    }
+    
+    return false;
+}
@@ -0,0 +1,30 @@
+struct RenderTile {
+    U32 x;
+    U32 y;
+    U32 width;
+    U32 height;
+};
+
+//NOTE(ans):
+// every thread owns one queue, the range packs head (low 32 bit) and tail (high 32 bit)
+// into one value so that popping and stealing is a single compare exchange.
+// padded to a cache line so threads don't fight over the same line
+struct TileQueue {
+    volatile U64 range;
+    U8 padding[56];
+};
+
+struct TileScheduler {
+    RenderTile* tiles;
+    U32 tileCount;
+    U32 tileCapacity;
+    
+    //NOTE(ans): layout of the current tile list, tiles are only rebuilt when it changes
+    U32 imageWidth;
+    U32 regionY;
+    U32 regionHeight;
+    U32 tileSize;
+    
+    TileQueue* queues;
+    U32 queueCount;
+};
@@ -1,150 +1,702 @@
+//NOTE(ans): turns the closest hit distance and primitive into the hit attributes, only called once per ray
+static inline void ResolveHit(V3 rayOrigin, V3 rayDirection,
+                              World* world,
+                              F32 hitDistance, U32 hitPlaneIndex, U32 hitSphereIndex,
+                              ShootRayResult* result) {
+    V3 hitNormal = {};
+    U32 hitMatIndex = 0;
+    
+    V3 hitPoint = rayOrigin + (rayDirection * hitDistance);
+    
+    //NOTE(ans): spheres are tested after planes, so a sphere index means the sphere is the closest hit
+    if(hitSphereIndex != U32_MAX) {
+        Sphere hitSphere = world->spheres[hitSphereIndex];
+        
+        hitMatIndex = hitSphere.matIndex;
+        hitNormal = Normalize(hitPoint - hitSphere.p);
+        
+        result->hitName = "Sphere";
+        result->hitId = hitSphere.id;
+        result->hit = 1;
+    } else if(hitPlaneIndex != U32_MAX) {
+        Plane hitPlane = world->planes[hitPlaneIndex];
+        V2 project2D = CreateV2(hitPoint);
+        
+        bool checkered = ((U32)((U32)project2D.x ^ (U32)project2D.y)) & 1;
+        
+        //NOTE(ans): 
+        // because our coordinates go from -Inv to +Inv we get a invalid checker pattern
+        // at 0.
+        // this solution can be simplified by transforming the coordinates to values between
+        // 0 and +Inv but for that the scene size needs to be known which it is not at the moment
+        if(project2D.y < 0) {
+            checkered = !checkered;
+        }
+        
+        if(project2D.x < 0) {
+            checkered = !checkered;
+        }
+        
+        if(checkered) {
+            hitMatIndex = hitPlane.matIndex;
+        } else {
+            hitMatIndex = hitPlane.secMatIndex;
+        }
+        
+        hitNormal = hitPlane.n;
+        
+        result->hitName = "Plane";
+        result->hitId = hitPlane.id;
+        result->hit = 1;
+    }
+    
+    result->hitMatIndex = hitMatIndex;
+    result->hitNormal = hitNormal;
+    result->hitPoint = hitPoint;
+}
+
 static inline void RayTraceObjects(V3 rayOrigin, V3 rayDirection,
                                    World* world,
                                    F32 traceMaxDistance,
-                                   ShootRayResult* result) {
+                                   ShootRayResult* result,
+                                   RayTraceStats* stats) {
     F32 tolerance = 0.01;
     
     F32 hitDistance = traceMaxDistance;
-    V3 hitNormal = {};
-    U32 hitMatIndex = 0;
+    U32 hitPlaneIndex = U32_MAX;
+    U32 hitSphereIndex = U32_MAX;
     
-    Plane* planes = world->planes;
+    F32x8 originX = SetF32x8(rayOrigin.x);
+    F32x8 originY = SetF32x8(rayOrigin.y);
+    F32x8 originZ = SetF32x8(rayOrigin.z);
+    F32x8 directionX = SetF32x8(rayDirection.x);
+    F32x8 directionY = SetF32x8(rayDirection.y);
+    F32x8 directionZ = SetF32x8(rayDirection.z);
+    
+    F32x8 toleranceLanes = SetF32x8(tolerance);
+    F32x8 negativeToleranceLanes = SetF32x8(-tolerance);
+    F32x8 zero = SetF32x8(0);
+    F32x8 two = SetF32x8(2);
+    F32x8 four = SetF32x8(4);
+    F32x8 noHit = SetF32x8(F32_MAX);
+    
+    //NOTE(ans): only the distance is tracked in the loops, hit attributes are resolved once at the end
+    PlaneLanes planes = world->planeLanes;
     U32 planeCount = world->planeCount;
+    
+    //NOTE(ans): counted locally, the stats only get written once per ray
+    U32 boxTestCount = 0;
+    U32 primitiveTestCount = planeCount;
     for(U32 planeIndex = 0; 
         planeIndex < planeCount; 
-        ++planeIndex) {
-        Plane currentPlane = planes[planeIndex];
+        planeIndex += LANE_WIDTH) {
+        F32x8 nx = LoadF32x8(planes.nx + planeIndex);
+        F32x8 ny = LoadF32x8(planes.ny + planeIndex);
+        F32x8 nz = LoadF32x8(planes.nz + planeIndex);
+        F32x8 d = LoadF32x8(planes.d + planeIndex);
+        
+        F32x8 divisor = directionX * nx + directionY * ny + directionZ * nz;
+        F32x8 divident = d - (originX * nx + originY * ny + originZ * nz);
+        F32x8 t = divident / divisor;
+        
+        F32x8 hitMask = ((divisor < negativeToleranceLanes) | (divisor > toleranceLanes)) & 
+            (t > toleranceLanes) & (t < SetF32x8(hitDistance));
+        
+        if(MaskBits(hitMask)) {
+            U32 lane = MinLane(Select(noHit, t, hitMask), &hitDistance);
+            hitPlaneIndex = planeIndex + lane;
+        }
+    }
+    
+    SphereLanes sphereLanes = world->sphereLanes;
+    BVHNode* nodes = world->sphereNodes;
+    
+    if(world->sphereNodeCount) {
+        V3 inverseDirection = InverseDirection(rayDirection);
         
-        F32 divisor = Inner(rayDirection, currentPlane.n);
+        //NOTE(ans): the ray direction is normalized, but keep a for rays that are not
+        F32x8 a = SetF32x8(Inner(rayDirection, rayDirection));
+        F32x8 fourA = four * a;
+        F32x8 laneIndex = LaneIndexF32x8();
         
-        if((divisor < -tolerance) || (divisor > tolerance)) {
-            F32 divident = Inner(currentPlane.p, currentPlane.n) - Inner(rayOrigin, currentPlane.n);
-            F32 t = divident / divisor;
+        //NOTE(ans): 
+        // every box is tested once, by its parent. the entry distance goes on the stack with the node,
+        // a closer hit found in the meantime drops the node without testing its box again
+        U32 nodeStack[BVH_MAX_DEPTH];
+        F32 entryStack[BVH_MAX_DEPTH];
+        U32 nodeStackCount = 0;
+        
+        ++boxTestCount;
+        F32 rootDistance = IntersectAABB(nodes[0].bounds, rayOrigin, inverseDirection, hitDistance);
+        if(rootDistance != F32_MAX) {
+            nodeStack[nodeStackCount] = 0;
+            entryStack[nodeStackCount++] = rootDistance;
+        }
+        
+        while(nodeStackCount) {
+            --nodeStackCount;
+            BVHNode* node = nodes + nodeStack[nodeStackCount];
+            F32 entryDistance = entryStack[nodeStackCount];
+            
+            if(entryDistance >= hitDistance) {
+                continue;
+            }
+            
+            if(node->count == 0) {
+                //NOTE(ans): push the farther child first so the closer one gets visited first
+                U32 leftIndex = node->firstIndex;
+                U32 rightIndex = leftIndex + 1;
+                F32 leftDistance = IntersectAABB(nodes[leftIndex].bounds, rayOrigin, inverseDirection, hitDistance);
+                F32 rightDistance = IntersectAABB(nodes[rightIndex].bounds, rayOrigin, inverseDirection, hitDistance);
+                boxTestCount += 2;
+                
+                U32 nearIndex = rightIndex;
+                U32 farIndex = leftIndex;
+                F32 nearDistance = rightDistance;
+                F32 farDistance = leftDistance;
+                if(leftDistance < rightDistance) {
+                    nearIndex = leftIndex;
+                    farIndex = rightIndex;
+                    nearDistance = leftDistance;
+                    farDistance = rightDistance;
+                }
+                
+                if(farDistance != F32_MAX) {
+                    nodeStack[nodeStackCount] = farIndex;
+                    entryStack[nodeStackCount++] = farDistance;
+                }
+                if(nearDistance != F32_MAX) {
+                    nodeStack[nodeStackCount] = nearIndex;
+                    entryStack[nodeStackCount++] = nearDistance;
+                }
+                
+                continue;
+            }
             
-            if(t > tolerance &&  t < hitDistance) {
-                hitDistance = t;
+            U32 sphereEnd = node->firstIndex + node->count;
+            primitiveTestCount += node->count;
+            for(U32 sphereIndex = node->firstIndex; 
+                sphereIndex < sphereEnd; 
+                sphereIndex += LANE_WIDTH) {
+                F32x8 relativeX = originX - LoadF32x8(sphereLanes.x + sphereIndex);
+                F32x8 relativeY = originY - LoadF32x8(sphereLanes.y + sphereIndex);
+                F32x8 relativeZ = originZ - LoadF32x8(sphereLanes.z + sphereIndex);
+                F32x8 radiusSquared = LoadF32x8(sphereLanes.radiusSquared + sphereIndex);
                 
+                F32x8 b = two * (directionX * relativeX + directionY * relativeY + directionZ * relativeZ);
+                F32x8 c = (relativeX * relativeX + relativeY * relativeY + relativeZ * relativeZ) - radiusSquared;
+                F32x8 rootTerm = b * b - fourA * c;
+                F32x8 rootValue = SquareRoot(Max(rootTerm, zero));
                 
-                V3 hitPoint = rayOrigin + (rayDirection * hitDistance);
-                V3 toHitPoint = hitPoint - currentPlane.p;
-                V2 project2D = CreateV2(hitPoint);
+                F32x8 negativeB = zero - b;
+                F32x8 tPlus = ((negativeB + rootValue) / two) * a;
+                F32x8 tMinus = ((negativeB - rootValue) / two) * a;
+                F32x8 distance = Min(tPlus, tMinus);
                 
-                bool checkered = ((U32)((U32)project2D.x ^ (U32)project2D.y)) & 1;
+                F32x8 validLanes = laneIndex < SetF32x8((F32)(sphereEnd - sphereIndex));
+                F32x8 hitMask = validLanes & (rootTerm > toleranceLanes) & 
+                    (distance > toleranceLanes) & (distance < SetF32x8(hitDistance));
                 
-                //NOTE(ans): 
-                // because our coordinates go from -Inv to +Inv we get a invalid checker pattern
-                // at 0.
-                // this solution can be simplified by transforming the coordinates to values between
-                // 0 and +Inv but for that the scene size needs to be known which it is not at the moment
-                if(project2D.y < 0) {
-                    checkered = !checkered;
+                if(MaskBits(hitMask)) {
+                    U32 lane = MinLane(Select(noHit, distance, hitMask), &hitDistance);
+                    hitSphereIndex = sphereIndex + lane;
                 }
+            }
+        }
+    }
+    
+    stats->boxTestCount += boxTestCount;
+    stats->primitiveTestCount += primitiveTestCount;
+    
+    ResolveHit(rayOrigin, rayDirection,
+               world,
+               hitDistance, hitPlaneIndex, hitSphereIndex,
+               result);
+}
+
+//NOTE(ans): 
+// any hit query for shadow rays, returns as soon as something other than ignoreId blocks
+// the ray before traceMaxDistance. no closest hit search and no hit attributes,
+// blockerDistance gets the distance to the blocker that ended the query when it is not 0.
+// the closest hit version counted a ray as visible when the shaded object itself was the closest
+// hit, this one skips the shaded object, so a blocker behind it still counts. for spheres and
+// planes that never differs, a sample that faces the light leaves the tangent plane on the side
+// away from its own object. a concave or overlapping shape would need the self hit distance as
+// traceMaxDistance to keep the old rule
+static inline bool RayTraceOcclusion(V3 rayOrigin, V3 rayDirection,
+                                     World* world,
+                                     F32 traceMaxDistance,
+                                     U32 ignoreId,
+                                     RayTraceStats* stats,
+                                     F32* blockerDistance) {
+    F32 tolerance = 0.01;
+    
+    F32x8 originX = SetF32x8(rayOrigin.x);
+    F32x8 originY = SetF32x8(rayOrigin.y);
+    F32x8 originZ = SetF32x8(rayOrigin.z);
+    F32x8 directionX = SetF32x8(rayDirection.x);
+    F32x8 directionY = SetF32x8(rayDirection.y);
+    F32x8 directionZ = SetF32x8(rayDirection.z);
+    
+    F32x8 toleranceLanes = SetF32x8(tolerance);
+    F32x8 negativeToleranceLanes = SetF32x8(-tolerance);
+    F32x8 maxDistance = SetF32x8(traceMaxDistance);
+    F32x8 zero = SetF32x8(0);
+    F32x8 two = SetF32x8(2);
+    F32x8 four = SetF32x8(4);
+    
+    PlaneLanes planes = world->planeLanes;
+    U32 planeCount = world->planeCount;
+    
+    U32 boxTestCount = 0;
+    U32 primitiveTestCount = planeCount;
+    for(U32 planeIndex = 0; 
+        planeIndex < planeCount; 
+        planeIndex += LANE_WIDTH) {
+        F32x8 nx = LoadF32x8(planes.nx + planeIndex);
+        F32x8 ny = LoadF32x8(planes.ny + planeIndex);
+        F32x8 nz = LoadF32x8(planes.nz + planeIndex);
+        F32x8 d = LoadF32x8(planes.d + planeIndex);
+        
+        F32x8 divisor = directionX * nx + directionY * ny + directionZ * nz;
+        F32x8 divident = d - (originX * nx + originY * ny + originZ * nz);
+        F32x8 t = divident / divisor;
+        
+        F32x8 hitMask = ((divisor < negativeToleranceLanes) | (divisor > toleranceLanes)) & 
+            (t > toleranceLanes) & (t < maxDistance);
+        
+        U32 hitBits = MaskBits(hitMask);
+        while(hitBits) {
+            U32 lane = FirstBit(hitBits);
+            hitBits &= hitBits - 1;
+            
+            if(world->planes[planeIndex + lane].id != ignoreId) {
+                stats->primitiveTestCount += primitiveTestCount;
                 
-                if(project2D.x < 0) {
-                    checkered = !checkered;
+                if(blockerDistance) {
+                    F32 distances[LANE_WIDTH];
+                    StoreF32x8(distances, t);
+                    *blockerDistance = distances[lane];
                 }
                 
-                if(checkered) {
-                    hitMatIndex = currentPlane.matIndex;
-                } else {
-                    hitMatIndex = currentPlane.secMatIndex;
+                return true;
+            }
+        }
+    }
+    
+    SphereLanes sphereLanes = world->sphereLanes;
+    BVHNode* nodes = world->sphereNodes;
+    
+    if(world->sphereNodeCount) {
+        V3 inverseDirection = InverseDirection(rayDirection);
+        
+        F32x8 a = SetF32x8(Inner(rayDirection, rayDirection));
+        F32x8 fourA = four * a;
+        F32x8 laneIndex = LaneIndexF32x8();
+        
+        //NOTE(ans): 
+        // any blocker ends the query, so children are not sorted by distance. the distance limit
+        // never changes, only boxes the ray enters go on the stack and nothing is tested on pop
+        U32 nodeStack[BVH_MAX_DEPTH];
+        U32 nodeStackCount = 0;
+        
+        ++boxTestCount;
+        if(IntersectAABB(nodes[0].bounds, rayOrigin, inverseDirection, traceMaxDistance) != F32_MAX) {
+            nodeStack[nodeStackCount++] = 0;
+        }
+        
+        while(nodeStackCount) {
+            BVHNode* node = nodes + nodeStack[--nodeStackCount];
+            
+            if(node->count == 0) {
+                U32 leftIndex = node->firstIndex;
+                U32 rightIndex = leftIndex + 1;
+                boxTestCount += 2;
+                
+                if(IntersectAABB(nodes[rightIndex].bounds, rayOrigin, inverseDirection, traceMaxDistance) != F32_MAX) {
+                    nodeStack[nodeStackCount++] = rightIndex;
+                }
+                if(IntersectAABB(nodes[leftIndex].bounds, rayOrigin, inverseDirection, traceMaxDistance) != F32_MAX) {
+                    nodeStack[nodeStackCount++] = leftIndex;
                 }
                 
-                hitNormal = currentPlane.n;
+                continue;
+            }
+            
+            U32 sphereEnd = node->firstIndex + node->count;
+            primitiveTestCount += node->count;
+            for(U32 sphereIndex = node->firstIndex; 
+                sphereIndex < sphereEnd; 
+                sphereIndex += LANE_WIDTH) {
+                F32x8 relativeX = originX - LoadF32x8(sphereLanes.x + sphereIndex);
+                F32x8 relativeY = originY - LoadF32x8(sphereLanes.y + sphereIndex);
+                F32x8 relativeZ = originZ - LoadF32x8(sphereLanes.z + sphereIndex);
+                F32x8 radiusSquared = LoadF32x8(sphereLanes.radiusSquared + sphereIndex);
+                
+                F32x8 b = two * (directionX * relativeX + directionY * relativeY + directionZ * relativeZ);
+                F32x8 c = (relativeX * relativeX + relativeY * relativeY + relativeZ * relativeZ) - radiusSquared;
+                F32x8 rootTerm = b * b - fourA * c;
+                F32x8 rootValue = SquareRoot(Max(rootTerm, zero));
+                
+                F32x8 negativeB = zero - b;
+                F32x8 tPlus = ((negativeB + rootValue) / two) * a;
+                F32x8 tMinus = ((negativeB - rootValue) / two) * a;
+                F32x8 distance = Min(tPlus, tMinus);
                 
-                result->hitName = "Plane";
-                result->hitId = currentPlane.id;
-                result->hit = 1;
+                F32x8 validLanes = laneIndex < SetF32x8((F32)(sphereEnd - sphereIndex));
+                F32x8 hitMask = validLanes & (rootTerm > toleranceLanes) & 
+                    (distance > toleranceLanes) & (distance < maxDistance);
+                
+                U32 hitBits = MaskBits(hitMask);
+                while(hitBits) {
+                    U32 lane = FirstBit(hitBits);
+                    hitBits &= hitBits - 1;
+                    
+                    if(world->spheres[sphereIndex + lane].id != ignoreId) {
+                        stats->boxTestCount += boxTestCount;
+                        stats->primitiveTestCount += primitiveTestCount;
+                        
+                        if(blockerDistance) {
+                            F32 distances[LANE_WIDTH];
+                            StoreF32x8(distances, distance);
+                            *blockerDistance = distances[lane];
+                        }
+                        
+                        return true;
+                    }
+                }
             }
         }
     }
     
-    // optimice performance
-    // - a only needs to be calculated once per ray
-    // - c part two only needs to be calculated once per sphere
+    stats->boxTestCount += boxTestCount;
+    stats->primitiveTestCount += primitiveTestCount;
     
-    Sphere* spheres = world->spheres;
-    U32 sphereCount = world->sphereCount;
+    return false;
+}
+
+//NOTE(ans): 
+// a packet only goes through the bvh together if all rays point into the same octant,
+// otherwise the rays visit different parts of the tree and get traced one by one
+static bool IsPacketCoherent(RayPacket* packet) {
+    U32 firstSigns = ((packet->directionX[0] < 0) << 0) | 
+        ((packet->directionY[0] < 0) << 1) | 
+        ((packet->directionZ[0] < 0) << 2);
+    
+    for(U32 rayIndex = 1; rayIndex < packet->rayCount; ++rayIndex) {
+        U32 signs = ((packet->directionX[rayIndex] < 0) << 0) | 
+            ((packet->directionY[rayIndex] < 0) << 1) | 
+            ((packet->directionZ[rayIndex] < 0) << 2);
+        
+        if(signs != firstSigns) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+//NOTE(ans): slab test for every ray of the packet, returns the closest entry distance or F32_MAX when all rays miss
+static inline F32 IntersectAABBPacket(AABB bounds, RayPacket* packet, U32 groupCount) {
+    V3 toMin = bounds.min - packet->origin;
+    V3 toMax = bounds.max - packet->origin;
+    
+    F32x8 toMinX = SetF32x8(toMin.x);
+    F32x8 toMinY = SetF32x8(toMin.y);
+    F32x8 toMinZ = SetF32x8(toMin.z);
+    F32x8 toMaxX = SetF32x8(toMax.x);
+    F32x8 toMaxY = SetF32x8(toMax.y);
+    F32x8 toMaxZ = SetF32x8(toMax.z);
+    F32x8 zero = SetF32x8(0);
+    F32x8 noHit = SetF32x8(F32_MAX);
+    
+    F32 result = F32_MAX;
+    for(U32 rayIndex = 0; rayIndex < groupCount * LANE_WIDTH; rayIndex += LANE_WIDTH) {
+        F32x8 inverseX = LoadF32x8(packet->inverseDirectionX + rayIndex);
+        F32x8 inverseY = LoadF32x8(packet->inverseDirectionY + rayIndex);
+        F32x8 inverseZ = LoadF32x8(packet->inverseDirectionZ + rayIndex);
+        
+        F32x8 t1x = toMinX * inverseX;
+        F32x8 t2x = toMaxX * inverseX;
+        F32x8 t1y = toMinY * inverseY;
+        F32x8 t2y = toMaxY * inverseY;
+        F32x8 t1z = toMinZ * inverseZ;
+        F32x8 t2z = toMaxZ * inverseZ;
+        
+        F32x8 tEnter = Max(Max(Min(t1x, t2x), Min(t1y, t2y)), Min(t1z, t2z));
+        F32x8 tExit = Min(Min(Max(t1x, t2x), Max(t1y, t2y)), Max(t1z, t2z));
+        
+        F32x8 hitMask = (tExit >= tEnter) & (tExit > zero) & 
+            (tEnter < LoadF32x8(packet->hitDistance + rayIndex));
+        
+        if(MaskBits(hitMask)) {
+            F32 groupEnter;
+            MinLane(Select(noHit, tEnter, hitMask), &groupEnter);
+            result = Min(result, groupEnter);
+        }
+    }
+    
+    return result;
+}
+
+static inline F32 PacketFarthestHit(RayPacket* packet, U32 groupCount) {
+    F32x8 farthest = LoadF32x8(packet->hitDistance);
+    for(U32 rayIndex = LANE_WIDTH; rayIndex < groupCount * LANE_WIDTH; rayIndex += LANE_WIDTH) {
+        farthest = Max(farthest, LoadF32x8(packet->hitDistance + rayIndex));
+    }
+    
+    F32 values[LANE_WIDTH];
+    StoreF32x8(values, farthest);
+    
+    F32 result = values[0];
+    for(U32 lane = 1; lane < LANE_WIDTH; ++lane) {
+        result = Max(result, values[lane]);
+    }
+    
+    return result;
+}
+
+//NOTE(ans): 
+// same tests as RayTraceObjects, but the lanes hold rays instead of primitives.
+// primary rays all start at the camera, so everything that only depends on the origin
+// is computed once per primitive instead of once per ray
+static void RayTracePacket(RayPacket* packet, World* world, RayTraceStats* stats) {
+    F32 tolerance = 0.01;
+    U32 rayCount = packet->rayCount;
+    U32 groupCount = (rayCount + LANE_WIDTH - 1) / LANE_WIDTH;
+    V3 rayOrigin = packet->origin;
+    
+    //NOTE(ans): the last group is filled up with copies of the first ray, their results are ignored
+    for(U32 rayIndex = 0; rayIndex < groupCount * LANE_WIDTH; ++rayIndex) {
+        if(rayIndex >= rayCount) {
+            packet->directionX[rayIndex] = packet->directionX[0];
+            packet->directionY[rayIndex] = packet->directionY[0];
+            packet->directionZ[rayIndex] = packet->directionZ[0];
+        }
+        
+        V3 direction = {packet->directionX[rayIndex], packet->directionY[rayIndex], packet->directionZ[rayIndex]};
+        V3 inverseDirection = InverseDirection(direction);
+        packet->inverseDirectionX[rayIndex] = inverseDirection.x;
+        packet->inverseDirectionY[rayIndex] = inverseDirection.y;
+        packet->inverseDirectionZ[rayIndex] = inverseDirection.z;
+        
+        packet->hitDistance[rayIndex] = F32_MAX;
+        packet->hitPlaneIndex[rayIndex] = U32_MAX;
+        packet->hitSphereIndex[rayIndex] = U32_MAX;
+    }
     
-    for(U32 sphereIndex = 0; 
-        sphereIndex < sphereCount; 
-        ++sphereIndex) {
+    F32x8 toleranceLanes = SetF32x8(tolerance);
+    F32x8 negativeToleranceLanes = SetF32x8(-tolerance);
+    F32x8 zero = SetF32x8(0);
+    F32x8 two = SetF32x8(2);
+    F32x8 four = SetF32x8(4);
+    
+    Plane* planes = world->planes;
+    U32 planeCount = world->planeCount;
+    
+    //NOTE(ans): counted per packet, every test counts once for each ray of the packet
+    U32 boxTestCount = 0;
+    U32 primitiveTestCount = planeCount;
+    for(U32 planeIndex = 0; 
+        planeIndex < planeCount; 
+        ++planeIndex) {
+        Plane currentPlane = planes[planeIndex];
         
-        Sphere currentSphere  = spheres[sphereIndex];
-        V3 rayOriginRelativSphere = rayOrigin - currentSphere.p;
+        F32x8 nx = SetF32x8(currentPlane.n.x);
+        F32x8 ny = SetF32x8(currentPlane.n.y);
+        F32x8 nz = SetF32x8(currentPlane.n.z);
+        F32x8 divident = SetF32x8(Inner(currentPlane.p, currentPlane.n) - Inner(rayOrigin, currentPlane.n));
         
+        for(U32 rayIndex = 0; rayIndex < groupCount * LANE_WIDTH; rayIndex += LANE_WIDTH) {
+            F32x8 divisor = LoadF32x8(packet->directionX + rayIndex) * nx + 
+                LoadF32x8(packet->directionY + rayIndex) * ny + 
+                LoadF32x8(packet->directionZ + rayIndex) * nz;
+            F32x8 t = divident / divisor;
+            F32x8 hitDistance = LoadF32x8(packet->hitDistance + rayIndex);
+            
+            F32x8 hitMask = ((divisor < negativeToleranceLanes) | (divisor > toleranceLanes)) & 
+                (t > toleranceLanes) & (t < hitDistance);
+            
+            U32 hitBits = MaskBits(hitMask);
+            if(hitBits) {
+                StoreF32x8(packet->hitDistance + rayIndex, Select(hitDistance, t, hitMask));
+                
+                for(U32 lane = 0; lane < LANE_WIDTH; ++lane) {
+                    if(hitBits & (1 << lane)) {
+                        packet->hitPlaneIndex[rayIndex + lane] = planeIndex;
+                    }
+                }
+            }
+        }
+    }
+    
+    Sphere* spheres = world->spheres;
+    BVHNode* nodes = world->sphereNodes;
+    
+    if(world->sphereNodeCount) {
+        //NOTE(ans): 
+        // like RayTraceObjects every box is tested once, by its parent. a node is dropped on pop
+        // when the packet enters it behind the farthest hit of all its rays
+        U32 nodeStack[BVH_MAX_DEPTH];
+        F32 entryStack[BVH_MAX_DEPTH];
+        U32 nodeStackCount = 0;
         
-        F32 a = Inner(rayDirection, rayDirection);
-        F32 b = 2*Inner(rayDirection, rayOriginRelativSphere);
-        F32 c = Inner(rayOriginRelativSphere, rayOriginRelativSphere) - (currentSphere.r * currentSphere.r);
-        F32 rootTerm = b*b - 4*a*c;
+        ++boxTestCount;
+        F32 rootDistance = IntersectAABBPacket(nodes[0].bounds, packet, groupCount);
+        if(rootDistance != F32_MAX) {
+            nodeStack[nodeStackCount] = 0;
+            entryStack[nodeStackCount++] = rootDistance;
+        }
         
-        if (rootTerm > tolerance) { 
-            F32 rootValue = SquareRoot(rootTerm);
+        while(nodeStackCount) {
+            --nodeStackCount;
+            BVHNode* node = nodes + nodeStack[nodeStackCount];
+            F32 entryDistance = entryStack[nodeStackCount];
             
-            F32 tPlus = (-b + rootValue) / 2*a;
-            F32 tMinus = (-b - rootValue) / 2*a;
+            if(entryDistance >= PacketFarthestHit(packet, groupCount)) {
+                continue;
+            }
             
-            F32 distance = tPlus;
-            if(tMinus < distance) {
-                distance = tMinus;
+            if(node->count == 0) {
+                //NOTE(ans): push the farther child first so the closer one gets visited first
+                U32 leftIndex = node->firstIndex;
+                U32 rightIndex = leftIndex + 1;
+                F32 leftDistance = IntersectAABBPacket(nodes[leftIndex].bounds, packet, groupCount);
+                F32 rightDistance = IntersectAABBPacket(nodes[rightIndex].bounds, packet, groupCount);
+                boxTestCount += 2;
+                
+                U32 nearIndex = rightIndex;
+                U32 farIndex = leftIndex;
+                F32 nearDistance = rightDistance;
+                F32 farDistance = leftDistance;
+                if(leftDistance < rightDistance) {
+                    nearIndex = leftIndex;
+                    farIndex = rightIndex;
+                    nearDistance = leftDistance;
+                    farDistance = rightDistance;
+                }
+                
+                if(farDistance != F32_MAX) {
+                    nodeStack[nodeStackCount] = farIndex;
+                    entryStack[nodeStackCount++] = farDistance;
+                }
+                if(nearDistance != F32_MAX) {
+                    nodeStack[nodeStackCount] = nearIndex;
+                    entryStack[nodeStackCount++] = nearDistance;
+                }
+                
+                continue;
             }
             
-            if(distance > tolerance) {
-                if(distance < hitDistance) {
-                    hitDistance = distance;
-                    hitMatIndex = currentSphere.matIndex;
+            U32 sphereEnd = node->firstIndex + node->count;
+            primitiveTestCount += node->count;
+            for(U32 sphereIndex = node->firstIndex; 
+                sphereIndex < sphereEnd; 
+                ++sphereIndex) {
+                Sphere currentSphere = spheres[sphereIndex];
+                V3 rayOriginRelativSphere = rayOrigin - currentSphere.p;
+                
+                F32x8 relativeX = SetF32x8(rayOriginRelativSphere.x);
+                F32x8 relativeY = SetF32x8(rayOriginRelativSphere.y);
+                F32x8 relativeZ = SetF32x8(rayOriginRelativSphere.z);
+                F32x8 c = SetF32x8(Inner(rayOriginRelativSphere, rayOriginRelativSphere) - 
+                                   (currentSphere.r * currentSphere.r));
+                
+                for(U32 rayIndex = 0; rayIndex < groupCount * LANE_WIDTH; rayIndex += LANE_WIDTH) {
+                    F32x8 directionX = LoadF32x8(packet->directionX + rayIndex);
+                    F32x8 directionY = LoadF32x8(packet->directionY + rayIndex);
+                    F32x8 directionZ = LoadF32x8(packet->directionZ + rayIndex);
+                    
+                    F32x8 a = directionX * directionX + directionY * directionY + directionZ * directionZ;
+                    F32x8 b = two * (directionX * relativeX + directionY * relativeY + directionZ * relativeZ);
+                    F32x8 rootTerm = b * b - four * a * c;
+                    F32x8 rootValue = SquareRoot(Max(rootTerm, zero));
                     
-                    V3 hitPoint = rayOrigin + (rayDirection * hitDistance);
-                    hitNormal = Normalize(hitPoint - currentSphere.p);
+                    F32x8 negativeB = zero - b;
+                    F32x8 tPlus = ((negativeB + rootValue) / two) * a;
+                    F32x8 tMinus = ((negativeB - rootValue) / two) * a;
+                    F32x8 distance = Min(tPlus, tMinus);
+                    F32x8 hitDistance = LoadF32x8(packet->hitDistance + rayIndex);
                     
+                    F32x8 hitMask = (rootTerm > toleranceLanes) & 
+                        (distance > toleranceLanes) & (distance < hitDistance);
                     
-                    result->hitName = "Sphere";
-                    result->hitId = currentSphere.id;
-                    result->hit = 1;
+                    U32 hitBits = MaskBits(hitMask);
+                    if(hitBits) {
+                        StoreF32x8(packet->hitDistance + rayIndex, Select(hitDistance, distance, hitMask));
+                        
+                        for(U32 lane = 0; lane < LANE_WIDTH; ++lane) {
+                            if(hitBits & (1 << lane)) {
+                                packet->hitSphereIndex[rayIndex + lane] = sphereIndex;
+                            }
+                        }
+                    }
                 }
             }
         }
     }
     
-    result->hitMatIndex = hitMatIndex;
-    result->hitNormal = hitNormal;
-    result->hitPoint = rayOrigin+(rayDirection*hitDistance);
+    stats->boxTestCount += (U64)boxTestCount * rayCount;
+    stats->primitiveTestCount += (U64)primitiveTestCount * rayCount;
 }
 
-static void GenerateLightSamples(V3* result, U32 resultCount,
-                                 V3 hitNormal, V3 hitPoint,
-                                 RandomSeries* series,
-                                 V3* randomCirclePoints,
-                                 U32 randomCirclePointCount) {
+//NOTE(ans):
+// a random shift along the squared radius and a random rotation, every sample point stays
+// uniform on the disk. a power of two prefix keeps one point per 1/n of the squared radius and
+// of the angle, only shifted, the 2d strata of the sobol net do not survive the shift
+static LightSampleScramble RandomLightSampleScramble(RandomSeries* series) {
+    LightSampleScramble result;
+    
+    F32 angle = RandUnitF32(series) * TAU;
     
+    result.shiftU = RandUnitF32(series);
+    result.cosRotation = cosf(angle);
+    result.sinRotation = sinf(angle);
     
+    return result;
+}
+
+//NOTE(ans):
+// the samples are the points firstIndex to firstIndex + resultCount of the sobol sequence, scrambled
+// and spread over a disk of radius around the hit point. the pilot samples and the rest continue the
+// same sequence, so a prefix already spreads over the whole disk, see RandomLightSampleScramble for
+// what the scramble keeps of the stratification. every shading point draws its own scramble,
+// so neighbouring pixels do not repeat the same pattern
+static void GenerateLightSamples(V3* result, U32 firstIndex, U32 resultCount,
+                                 V3 hitNormal, V3 hitPoint,
+                                 SobolDiskPoint* sobolDiskPoints,
+                                 LightSampleScramble scramble,
+                                 F32 radius) {
     F32 shadowBias = 0.0001f;
     F32 lowerBound = 0.0000001f;
     
     V3 sampleOrigin = hitPoint + hitNormal * shadowBias;
     
+    //NOTE(ans): built in one go, writing single components of a simd V3 stalls the next vector load
     V3 v;
     
     if(lowerBound > hitNormal.x && lowerBound > hitNormal.y) {
-        v.x = hitNormal.z;
-        v.y = 0;
-        v.z = -hitNormal.x;
+        v = {hitNormal.z, 0, -hitNormal.x};
     } else {
-        v.x = -hitNormal.y;
-        v.y = hitNormal.x;
-        v.z = 0;
+        v = {-hitNormal.y, hitNormal.x, 0};
     }
     
     V3 w = Cross(hitNormal, v);
     
     for(U32 resultIndex = 0; resultIndex < resultCount; ++ resultIndex) {
+        SobolDiskPoint sobolPoint = sobolDiskPoints[firstIndex + resultIndex];
         
-        U32 randomSampleIndex = RandomU32(series, randomCirclePointCount);
-        V3 randomPoint = randomCirclePoints[randomSampleIndex];
+        F32 u = sobolPoint.u + scramble.shiftU;
+        if(u >= 1.0f) {
+            u -= 1.0f;
+        }
+        
+        F32 r = radius * SquareRoot(u);
+        F32 x = r * (sobolPoint.cosAngle * scramble.cosRotation - sobolPoint.sinAngle * scramble.sinRotation);
+        F32 y = r * (sobolPoint.sinAngle * scramble.cosRotation + sobolPoint.cosAngle * scramble.sinRotation);
         
         //transform samples to hit normal system
-        V3 samplePoint = (v * randomPoint.x) + (w * randomPoint.y);
+        V3 samplePoint = (v * x) + (w * y);
         
         //transform samples to hitpoint
         samplePoint = samplePoint + sampleOrigin;
@@ -153,15 +705,100 @@ static void GenerateLightSamples(V3* result, U32 resultCount,
     }
 }
 
+//NOTE(ans): returns the unshadowed intensity of one light sample and the shadow ray that tests it
+static inline V3 CalculateLightSample(Light light, V3 hitNormal, V3 lightRayOrigin,
+                                      V3* lightRayDirection, F32* traceMaxDistance) {
+    V3 lightIntensity = {1,1,1};
+    *lightRayDirection = {};
+    *traceMaxDistance = F32_MAX;
+    
+    switch(light.type) {
+        case(LightType_Directional):  {
+            *lightRayDirection = Normalize(light.d.invertedDirection);
+            
+            F32 shading = Inner(hitNormal, Normalize(light.d.invertedDirection));
+            shading= Max(shading, 0);
+            
+            lightIntensity = light.color * light.intensity * shading;
+        } break;
+        case(LightType_Point): {
+            V3 direction = light.p.origin - lightRayOrigin;
+            F32 rSquare = Inner(direction);
+            *lightRayDirection = Normalize(direction);
+            *traceMaxDistance = SquareRoot(rSquare);
+            
+            V3 fallOff = (light.color*light.intensity) / (4.0f*PI*rSquare);
+            
+            F32 shading = Inner(hitNormal, Normalize(*lightRayDirection));
+            shading = Max(shading, 0);
+            
+            lightIntensity = fallOff * shading;
+        } break;
+    }
+    
+    return lightIntensity;
+}
+
+//NOTE(ans):
+// light samples of a hit after depth bounces whose shaded color has weight on the pixel. every
+// sample is uniform on the disk and a prefix spreads over all of it, so fewer samples only add
+// noise and no bias
+static inline U32 GetLightSampleBudget(ShadingData* shading, U32 depth, F32 weight) {
+    U32 result = shading->lightSamplePointCount;
+    
+    if(depth > REFLECTION_MAX_DEPTH) {
+        depth = REFLECTION_MAX_DEPTH;
+    }
+    
+    U32 depthCap = shading->lightSampleDepthCaps[depth];
+    if(depthCap && depthCap < result) {
+        result = depthCap;
+    }
+    
+    if(shading->lightSampleMinCount) {
+        U32 weightedCount = (U32)ceilf((F32)shading->lightSamplePointCount * weight);
+        if(weightedCount < shading->lightSampleMinCount) {
+            weightedCount = shading->lightSampleMinCount;
+        }
+        
+        if(weightedCount < result) {
+            result = weightedCount;
+        }
+    }
+    
+    if(result == 0) {
+        result = 1;
+    }
+    
+    return result;
+}
+
+//NOTE(ans): 
+// the pilot samples agree when all of them were blocked or all of them reached the light.
+// pilots that all faced away from the light traced nothing and say nothing about the other
+// samples, a wider sample can still see the light so the rest gets traced
+static inline bool PilotSamplesAgree(U32 tracedCount, U32 visibleCount) {
+    bool result = tracedCount != 0 && (visibleCount == 0 || visibleCount == tracedCount);
+    
+    return result;
+}
+
 static V3 RayTraceLights(World* world,
                          U32 objectId, V3 materialColor, 
                          V3 hitNormal, V3 hitPoint,
-                         U32 lightSamplePointCount, V3* lightSampleDataBuffer,
-                         RandomSeries* series,
-                         V3* randomCirclePoints,
-                         U32 randomCirclePointCount) {
+                         U32 lightSamplePointCount,
+                         ShadingData* shading) {
     V3 resultColor = {};
     
+    V3* lightSampleDataBuffer = shading->lightSampleDataBuffer;
+    RayTraceStats* stats = shading->stats;
+    
+    //NOTE(ans): 
+    // the pilot samples are traced first, if they all agree the hit is fully lit or fully
+    // shadowed and the remaining samples take over their visibility without tracing
+    U32 pilotCount = shading->lightPilotSampleCount;
+    bool adaptive = pilotCount > 0 && pilotCount < lightSamplePointCount;
+    
     Light* lights = world->lights;
     U32 lightCount = world->lightCount;
     
@@ -173,155 +810,259 @@ static V3 RayTraceLights(World* world,
         Light currentLight = lights[lightIndex];
         V3 colorShading = {};
         
-        GenerateLightSamples(lightSampleDataBuffer, lightSamplePointCount, 
+        ShadowMap* shadowMap = 0;
+        if(shading->shadowMaps && shading->shadowMaps[lightIndex].size) {
+            shadowMap = shading->shadowMaps + lightIndex;
+        }
+        
+        //NOTE(ans): looked up before the samples get generated, new cache entries use the same buffer
+        F32 cachedVisibility = 0;
+        bool cached = shading->visibilityCache && 
+            LookupVisibilityCache(shading->visibilityCache, world,
+                                  lightIndex, objectId, hitPoint,
+                                  lightSampleDataBuffer, stats,
+                                  &cachedVisibility);
+        
+        GenerateLightSamples(lightSampleDataBuffer, 0, lightSamplePointCount, 
                              hitNormal, hitPoint,
-                             series,
-                             randomCirclePoints,
-                             randomCirclePointCount);
+                             shading->sobolDiskPoints,
+                             RandomLightSampleScramble(shading->series),
+                             shading->lightSampleRadius);
+        
+        U32 tracedCount = 0;
+        U32 visibleCount = 0;
+        U32 mapCount = 0;
+        bool pilotAgreed = false;
         
         F32 lightSampleContribution = 1.0f / lightSamplePointCount;
         for(U32 lightSamplePointIndex = 0; lightSamplePointIndex < lightSamplePointCount; ++lightSamplePointIndex){
-            V3 lightRayOrigin = lightSampleDataBuffer[lightSamplePointIndex];
-            
-            V3 lightRayDirection = {};
-            V3 lightIntensity = {1,1,1};
-            F32 traceMaxDistance = F32_MAX;
-            switch(currentLight.type) {
-                case(LightType_Directional):  {
-                    lightRayDirection = Normalize(currentLight.d.invertedDirection);
-                    
-                    F32 shading = Inner(hitNormal, Normalize(currentLight.d.invertedDirection));
-                    shading= Max(shading, 0);
-                    
-                    lightIntensity = currentLight.color * currentLight.intensity * shading;
-                } break;
-                case(LightType_Point): {
-                    V3 direction = currentLight.p.origin - lightRayOrigin;
-                    F32 rSquare = Inner(direction);
-                    lightRayDirection = Normalize(direction);
-                    traceMaxDistance = SquareRoot(rSquare);
-                    
-                    V3 fallOff = (currentLight.color*currentLight.intensity) / (4.0f*PI*rSquare);
-                    
-                    F32 shading = Inner(hitNormal, Normalize(lightRayDirection));
-                    shading = Max(shading, 0);
-                    
-                    lightIntensity = fallOff * shading;
-                } break;
+            if(adaptive && !cached && lightSamplePointIndex == pilotCount) {
+                pilotAgreed = PilotSamplesAgree(tracedCount, visibleCount);
+                
+                if(!pilotAgreed) {
+                    ++stats->penumbraCount;
+                } else if(!visibleCount) {
+                    //NOTE(ans): fully shadowed, the remaining samples add nothing
+                    break;
+                }
             }
             
-            ShootRayResult lightResult = {};
-            RayTraceObjects(lightRayOrigin, lightRayDirection,
-                            world,
-                            traceMaxDistance,
-                            &lightResult);
+            V3 lightRayOrigin = lightSampleDataBuffer[lightSamplePointIndex];
             
-            bool selfIntersect = lightResult.hitId == objectId;
-            F32 visible = (F32)(!lightResult.hit || (lightResult.hit && selfIntersect));
+            V3 lightRayDirection;
+            F32 traceMaxDistance;
+            V3 lightIntensity = CalculateLightSample(currentLight, hitNormal, lightRayOrigin,
+                                                     &lightRayDirection, &traceMaxDistance);
+            
+            //NOTE(ans): samples facing away from the light add nothing, no need to know if they are blocked
+            if(lightIntensity.r == 0 && lightIntensity.g == 0 && lightIntensity.b == 0) {
+                continue;
+            }
             
+            F32 visible;
+            if(cached) {
+                visible = cachedVisibility;
+            } else if(pilotAgreed) {
+                visible = (F32)(visibleCount != 0);
+            } else {
+                ShadowMapResult mapResult = ShadowMapResult_Unknown;
+                if(shadowMap) {
+                    mapResult = LookupShadowMap(shadowMap, world, lightRayOrigin, objectId);
+                }
+                
+                if(mapResult == ShadowMapResult_Unknown) {
+                    visible = (F32)!RayTraceOcclusion(lightRayOrigin, lightRayDirection,
+                                                      world,
+                                                      traceMaxDistance,
+                                                      objectId,
+                                                      stats,
+                                                      0);
+                } else {
+                    visible = (F32)(mapResult == ShadowMapResult_Lit);
+                    ++mapCount;
+                }
+                
+                ++tracedCount;
+                visibleCount += (U32)visible;
+            }
             
             colorShading = colorShading + (lightIntensity  * visible * lightSampleContribution);
             
         }
         
         resultColor = resultColor + materialColor * colorShading * lightContribution;
+        
+        stats->shadowRayCount += tracedCount - mapCount;
+        stats->shadowMapSampleCount += mapCount;
+        stats->visibilityCacheShadingCount += (U64)cached;
+        ++stats->lightShadingCount;
     }
     
     return resultColor;
 }
 
-static V3 CalculateColor(V3 rayOrigin, V3 rayDirection,
-                         World* world,
-                         U32 lightSamplePointCount, V3* lightSampleDataBuffer,
-                         U32 depth, U32 lastHitId,
-                         RandomSeries* series,
-                         V3* randomCirclePoints,
-                         U32 randomCirclePointCount) {
-    Material* materials = world->materials;
+//NOTE(ans): 
+// same weights as Lerp(Lerp(diffuse, reflection, specular), absorbtion, shaded),
+// without diffuse bounces the shaded color stands in for the diffuse one.
+// returns the weight of the shaded color
+static inline F32 CalculateBounceWeights(Material material, U32 depth, U32 diffuseBounce,
+                                         F32* specularWeight, F32* diffuseWeight) {
+    *specularWeight = 0;
+    *diffuseWeight = 0;
     
+    if(depth < REFLECTION_MAX_DEPTH) {
+        *specularWeight = (1 - material.absorbtion) * material.reflection;
+        
+        if(diffuseBounce) {
+            *diffuseWeight = (1 - material.absorbtion) * (1 - material.reflection);
+        }
+    }
     
-    ShootRayResult result = {};
-    RayTraceObjects(rayOrigin,
-                    rayDirection,
-                    world,
-                    F32_MAX,
-                    &result);
+    F32 result = 1 - *specularWeight - *diffuseWeight;
     
-    if(result.hit) {
-        
-#if DEBUG_SELFINTERSECTION 
-        if(result.hitId == lastHitId) {
-            DebuggerBreak();
+    return result;
+}
+
+//NOTE(ans): 
+// picks the direction of the next bounce and updates the throughput,
+// returns false when the path ends here
+static inline bool NextBounce(V3 hitNormal, V3 rayDirection,
+                              F32 specularWeight, F32 diffuseWeight,
+                              ShadingData* shading,
+                              F32* throughput, V3* newRayDirection) {
+    F32 bounceWeight = specularWeight + diffuseWeight;
+    if(bounceWeight <= 0) {
+        return false;
+    }
+    
+    //NOTE(ans): only one bounce is followed, diffuse or specular get picked by their weight
+    if(diffuseWeight > 0 && RandUnitF32(shading->series) * bounceWeight < diffuseWeight) {
+        V3 randomPoint = RandomPointInUnitSphere(hitNormal, shading->series);
+        *newRayDirection = Normalize(hitNormal + randomPoint);
+    } else {
+        *newRayDirection = VectorReflected(rayDirection, hitNormal);
+    }
+    
+    *throughput *= bounceWeight;
+    if(*throughput < shading->throughputCutoff) {
+        if(!shading->russianRoulette) {
+            return false;
         }
-#endif
         
+        F32 survival = *throughput / shading->throughputCutoff;
+        if(RandUnitF32(shading->series) >= survival) {
+            return false;
+        }
         
-        Material material = materials[result.hitMatIndex];
-        
-#if DEBUG_DISABLE_SHADING     
-        V3 color = material.color;
-#else
-        V3 shadedColor = RayTraceLights(world,
-                                        result.hitId, material.color, 
-                                        result.hitNormal, result.hitPoint,
-                                        lightSamplePointCount, lightSampleDataBuffer,
-                                        series,
-                                        randomCirclePoints,
-                                        randomCirclePointCount);
-        V3 color = shadedColor;
+        *throughput = shading->throughputCutoff;
+    }
+    
+    ++shading->stats->reflectionRayCount;
+    
+    return true;
+}
+
+//NOTE(ans): 
+// shading part of CalculateColor, packets resolve their primary hits first and start here.
+// reflections are followed in a loop, throughput is the weight the current hit has on the final color.
+// a bounce of weight 0 is never traced and a hit of weight 0 is never shaded, paths below 
+// throughputCutoff stop or, with russian roulette, survive with a probability that keeps the result unbiased
+static V3 ShadeHit(ShootRayResult result, V3 rayDirection,
+                   World* world,
+                   U32 depth, U32 lastHitId,
+                   ShadingData* shading) {
+    Material* materials = world->materials;
+    
+    V3 color = {};
+    F32 throughput = 1.0f;
+    
+    for(;;) {
+        if(!result.hit) {
+            color = color + materials[result.hitMatIndex].color * throughput;
+            break;
+        }
         
+#if DEBUG_SELFINTERSECTION 
+        if(result.hitId == lastHitId) {
+            DebuggerBreak();
+        }
 #endif
         
+        Material material = materials[result.hitMatIndex];
         
-        if(depth < 8) {
-            //Note(ans):
-            //offset origin by an offest, because intersections can under the actual objects because
-            //of rounding errors
-            V3 newRayOrigin = result.hitPoint;
-            
-            V3 specularDirection = VectorReflected(rayDirection, result.hitNormal);
-            V3 specularColor = CalculateColor(newRayOrigin, specularDirection,
-                                              world,
-                                              lightSamplePointCount, lightSampleDataBuffer,
-                                              depth + 1, result.hitId,
-                                              series,
-                                              randomCirclePoints,
-                                              randomCirclePointCount);
-            
-#if 0       
-            V3 unitSphereOrigin = newRayOrigin + result.hitNormal;
-            V3 randomPoint = RandomPointInUnitSphere(unitSphereOrigin);
-            V3 diffuseDirection = randomPoint - newRayOrigin;
-            
-            V3 diffuseColor = CalculateColor(newRayOrigin, diffuseDirection,
-                                             world,
-                                             lightSamplePointCount, lightSampleDataBuffer, sampleRegion,
-                                             depth + 1, result.hitId,
-                                             series,
-                                             randomCirclePoints,
-                                             randomCirclePointCount);
-#endif
-            
-            V3 diffuseColor = color;
+        F32 specularWeight, diffuseWeight;
+        F32 shadedWeight = CalculateBounceWeights(material, depth, shading->diffuseBounce,
+                                                  &specularWeight, &diffuseWeight);
+        
+        if(shadedWeight > 0) {
+#if DEBUG_DISABLE_SHADING     
+            V3 shadedColor = material.color;
+#else
+            U32 lightSamplePointCount = GetLightSampleBudget(shading, depth, shadedWeight * throughput);
             
-            V3 reflectionColor = Lerp(diffuseColor, material.reflection, specularColor);  
+            V3 shadedColor = RayTraceLights(world,
+                                            result.hitId, material.color, 
+                                            result.hitNormal, result.hitPoint,
+                                            lightSamplePointCount,
+                                            shading);
+#endif
             
-            color = Lerp(reflectionColor, material.absorbtion, color);
+            color = color + shadedColor * (shadedWeight * throughput);
         }
         
-        return color;
-    } else {
-        return materials[result.hitMatIndex].color;
+        V3 newRayDirection;
+        if(!NextBounce(result.hitNormal, rayDirection,
+                       specularWeight, diffuseWeight,
+                       shading,
+                       &throughput, &newRayDirection)) {
+            break;
+        }
+        
+        //Note(ans):
+        //offset origin by an offest, because intersections can under the actual objects because
+        //of rounding errors
+        V3 newRayOrigin = result.hitPoint;
+        lastHitId = result.hitId;
+        
+        result = {};
+        RayTraceObjects(newRayOrigin, newRayDirection,
+                        world,
+                        F32_MAX,
+                        &result,
+                        shading->stats);
+        
+        rayDirection = newRayDirection;
+        ++depth;
     }
+    
+    return color;
 }
 
-static PixelSamplingPoints CalculatePixelSamplingPoints(V3 bl, 
-                                                        V3 sampleRegionX, V3 sampleRegionY,
-                                                        U32 samplesToTake, U32 samplesPerDim) {
-    //grid uniform distribution
-    PixelSamplingPoints result;
-    result.count = samplesToTake;
+static V3 CalculateColor(V3 rayOrigin, V3 rayDirection,
+                         World* world,
+                         U32 depth, U32 lastHitId,
+                         ShadingData* shading) {
+    ShootRayResult result = {};
+    RayTraceObjects(rayOrigin,
+                    rayDirection,
+                    world,
+                    F32_MAX,
+                    &result,
+                    shading->stats);
     
+    V3 color = ShadeHit(result, rayDirection,
+                        world,
+                        depth, lastHitId,
+                        shading);
+    
+    return color;
+}
+
+//NOTE(ans): sampleIndex walks the samplesPerDim x samplesPerDim grid column by column
+static V3 CalculatePixelSamplingPoint(V3 bl, 
+                                      V3 sampleRegionX, V3 sampleRegionY,
+                                      U32 samplesPerDim, U32 sampleIndex) {
+    //grid uniform distribution
     V3 sampleOffsetX = sampleRegionX / (F32)samplesPerDim;
     V3 sampleOffsetY = sampleRegionY / (F32)samplesPerDim;
     
@@ -330,17 +1071,22 @@ static PixelSamplingPoints CalculatePixelSamplingPoints(V3 bl,
     
     V3 sampleBl = bl + sampleOffsetXHalf + sampleOffsetYHalf;
     
-    U32 sampleCount = 0;
-    for(U32 x = 0; x < samplesPerDim; ++x) {
-        V3 sampleX = sampleOffsetX * (F32)x;
-        for(U32 y = 0; y < samplesPerDim; ++y) {
-            V3 sampleY = sampleOffsetY * (F32)y;
-            
-            V3 sample = sampleBl + sampleX + sampleY;
-            result.points[sampleCount] = sample;
-            
-            ++sampleCount;
-        }
+    U32 x = sampleIndex / samplesPerDim;
+    U32 y = sampleIndex % samplesPerDim;
+    
+    V3 sampleX = sampleOffsetX * (F32)x;
+    V3 sampleY = sampleOffsetY * (F32)y;
+    
+    V3 result = sampleBl + sampleX + sampleY;
+    
+    return result;
+}
+
+//NOTE(ans): primary rays per pixel of the modes with a fixed sample grid, 1 for the others
+static inline U32 GetSamplesPerPixel(Options* options) {
+    U32 result = 1;
+    if(options->saaMode == SAAMode_SSAA || options->saaMode == SAAMode_MSAA) {
+        result = options->samplesToTake;
     }
     
     return result;
@@ -351,136 +1097,762 @@ static void CalculateSAAData(SAAMode mode,
                              U32 imageWidth, U32 imageHeight,
                              V3 cameraX, V3 cameraY,
                              SAAData* data) {
-    if(mode == SAAMode_SSAA) {
-        V3 pixelSize;
-        pixelSize.x = filmWidth / imageWidth;
-        pixelSize.y = filmHeight / imageHeight;
+    //NOTE(ans): progressive renders use the sample region for every mode, so it is always calculated
+    V3 pixelSize;
+    pixelSize.x = filmWidth / imageWidth;
+    pixelSize.y = filmHeight / imageHeight;
+    
+    V3 sampleRegionX = cameraX * pixelSize.x;
+    data->sampleRegionX = sampleRegionX;
+    
+    V3 sampleRegionY = cameraY * pixelSize.y;
+    data->sampleRegionY = sampleRegionY;
+}
+
+static inline void StoreGBufferSample(GBufferSample* sample, ShootRayResult result) {
+    sample->hit = result.hit;
+    sample->hitMatIndex = result.hitMatIndex;
+    sample->hitId = result.hitId;
+    sample->hitNormal = result.hitNormal;
+    sample->hitPoint = result.hitPoint;
+}
+
+//NOTE(ans): the shading data points at data->series, so everything traced after this draws from the new series
+static inline void BeginSample(RayTraceThreadData* data, U32 pixelX, U32 pixelY, U32 sampleIndex) {
+    data->series = SampleRandomSeries(pixelX, pixelY, sampleIndex,
+                                      data->options.frameIndex, data->options.randomSeed);
+}
+
+//NOTE(ans): 
+// the primary hit of a sample of RayTraceTile, traced or read from the g-buffer when reshading.
+// recording stores every traced hit, the samples of a pixel are next to each other
+static ShootRayResult TracePrimarySample(RayTraceThreadData* data, V3 rayDirection,
+                                         U32 pixelX, U32 pixelY, U32 sampleIndex, U32 samplesPerPixel) {
+    ShootRayResult result = {};
+    
+    GBufferSample* gBufferSample = 0;
+    if(data->gBufferSamples) {
+        U64 pixelIndex = (U64)pixelY * data->imageWidth + pixelX;
+        gBufferSample = data->gBufferSamples + pixelIndex * samplesPerPixel + sampleIndex;
+    }
+    
+    if(data->reshade) {
+        result.hit = gBufferSample->hit;
+        result.hitMatIndex = gBufferSample->hitMatIndex;
+        result.hitId = gBufferSample->hitId;
+        result.hitNormal = gBufferSample->hitNormal;
+        result.hitPoint = gBufferSample->hitPoint;
+    } else {
+        RayTraceObjects(data->cameraP, rayDirection,
+                        data->world,
+                        F32_MAX,
+                        &result,
+                        &data->stats);
+        
+        ++data->stats.primaryRayCount;
+        
+        if(gBufferSample) {
+            StoreGBufferSample(gBufferSample, result);
+        }
+    }
+    
+    return result;
+}
+
+//NOTE(ans): 
+// takes samplesToTake samples per round until the standard error of the pixel mean drops below
+// sampleVarianceThreshold or samplesMax is reached. as long as the samples of a pixel hit
+// different objects the pixel sits on an edge and keeps refining. material changes on one object,
+// like the squares of a checker plane, are left to the variance test.
+// after the corners sample positions follow the halton sequence, so any number of samples stays well spread
+static V3 RayTracePixelAdaptive(RayTraceThreadData* data, ShadingData* shading, U32 pixelX, U32 pixelY, V3 filmP) {
+    Options options = data->options;
+    SAAData saaData = data->saaData;
+    
+    V3 sum = {};
+    V3 sumSquared = {};
+    U32 sampleCount = 0;
+    
+    U32 firstHitId = U32_MAX;
+    bool edge = false;
+    
+    U32 roundSize = options.samplesToTake;
+    if(roundSize == 0) {
+        roundSize = 1;
+    }
+    
+    U32 samplesMax = options.samplesMax;
+    if(samplesMax == 0) {
+        samplesMax = 1;
+    }
+    
+    while(sampleCount < samplesMax) {
+        U32 roundEnd = sampleCount + roundSize;
+        if(roundEnd > samplesMax) {
+            roundEnd = samplesMax;
+        }
+        
+        for(; sampleCount < roundEnd; ++sampleCount) {
+            //NOTE(ans): 
+            // the first samples sit on the pixel corners, every straight edge through the
+            // pixel separates at least one corner from the others
+            F32 u, v;
+            if(sampleCount < 4) {
+                u = (F32)(sampleCount & 1);
+                v = (F32)(sampleCount >> 1);
+            } else {
+                u = Halton(sampleCount - 3, 2);
+                v = Halton(sampleCount - 3, 3);
+            }
+            
+            V3 samplePoint = filmP + saaData.sampleRegionX * u + saaData.sampleRegionY * v;
+            
+            BeginSample(data, pixelX, pixelY, sampleCount);
+            
+            V3 rayOrigin = data->cameraP;
+            V3 rayDirection = Normalize(samplePoint - data->cameraP);
+            
+            ShootRayResult result = {};
+            RayTraceObjects(rayOrigin, rayDirection,
+                            data->world,
+                            F32_MAX,
+                            &result,
+                            shading->stats);
+            
+            U32 hitId = result.hit ? result.hitId : U32_MAX;
+            if(sampleCount == 0) {
+                firstHitId = hitId;
+            } else if(hitId != firstHitId) {
+                edge = true;
+            }
+            
+            V3 color = ShadeHit(result, rayDirection,
+                                data->world,
+                                0, U32_MAX,
+                                shading);
+            
+            sum = sum + color;
+            sumSquared = sumSquared + color * color;
+        }
+        
+        if(edge || sampleCount < 2 * roundSize) {
+            continue;
+        }
+        
+        //NOTE(ans): variance of the mean per channel, the largest channel decides
+        V3 mean = sum / (F32)sampleCount;
+        V3 variance = (sumSquared / (F32)sampleCount) - mean * mean;
+        F32 maxVariance = Max(Max(variance.r, variance.g), variance.b) / (F32)sampleCount;
+        
+        if(maxVariance < options.sampleVarianceThreshold * options.sampleVarianceThreshold) {
+            break;
+        }
+    }
+    
+    data->stats.primaryRayCount += sampleCount;
+    
+    V3 result = sum / (F32)sampleCount;
+    
+    return result;
+}
+
+//NOTE(ans): 
+// resolves the samples of a SAAMode_MSAA pixel, samples that hit the same object with the same material
+// share one ShadeHit weighted by how many of them hit it. the shared hit is the sample closest to the
+// pixel center, so the shading does not lean towards a corner of the pixel
+static V3 ShadePixelMultisample(RayTraceThreadData* data, ShadingData* shading,
+                                U32 pixelX, U32 pixelY,
+                                ShootRayResult* results, V3* rayDirections, U32 sampleCount) {
+    U32 samplesPerDim = data->options.samplesPerDim;
+    F32 center = (F32)(samplesPerDim - 1) * 0.5f;
+    
+    U32 groupSamples[MSAA_MAX_SAMPLES];
+    U32 groupCounts[MSAA_MAX_SAMPLES];
+    F32 groupCenterDistances[MSAA_MAX_SAMPLES];
+    U32 groupCount = 0;
+    
+    for(U32 sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex) {
+        ShootRayResult* result = results + sampleIndex;
+        
+        //NOTE(ans): same grid walk as CalculatePixelSamplingPoint
+        F32 offsetX = (F32)(sampleIndex / samplesPerDim) - center;
+        F32 offsetY = (F32)(sampleIndex % samplesPerDim) - center;
+        F32 centerDistance = offsetX * offsetX + offsetY * offsetY;
+        
+        U32 groupIndex = 0;
+        for(; groupIndex < groupCount; ++groupIndex) {
+            ShootRayResult* groupResult = results + groupSamples[groupIndex];
+            
+            if(groupResult->hit == result->hit &&
+               groupResult->hitId == result->hitId &&
+               groupResult->hitMatIndex == result->hitMatIndex) {
+                break;
+            }
+        }
+        
+        if(groupIndex == groupCount) {
+            groupSamples[groupIndex] = sampleIndex;
+            groupCounts[groupIndex] = 0;
+            groupCenterDistances[groupIndex] = centerDistance;
+            ++groupCount;
+        }
+        
+        ++groupCounts[groupIndex];
+        if(centerDistance < groupCenterDistances[groupIndex]) {
+            groupSamples[groupIndex] = sampleIndex;
+            groupCenterDistances[groupIndex] = centerDistance;
+        }
+    }
+    
+    V3 pixel = {};
+    for(U32 groupIndex = 0; groupIndex < groupCount; ++groupIndex) {
+        U32 sampleIndex = groupSamples[groupIndex];
         
-        V3 sampleRegionX = cameraX * pixelSize.x;
-        data->sampleRegionX = sampleRegionX;
+        BeginSample(data, pixelX, pixelY, sampleIndex);
         
-        V3 sampleRegionY = cameraY * pixelSize.y;
-        data->sampleRegionY = sampleRegionY;
+        V3 color = ShadeHit(results[sampleIndex], rayDirections[sampleIndex],
+                            data->world,
+                            0, U32_MAX,
+                            shading);
+        
+        pixel = pixel + color * ((F32)groupCounts[groupIndex] / (F32)sampleCount);
     }
+    
+    return pixel;
+}
+
+static ShadingData GetShadingData(RayTraceThreadData* data) {
+    ShadingData result;
+    
+    result.lightSamplePointCount = data->options.samplesPerShading;
+    result.lightPilotSampleCount = data->options.samplesPerShadingPilot;
+    result.lightSampleDepthCaps = data->options.samplesPerShadingAtDepth;
+    result.lightSampleMinCount = data->options.samplesPerShadingMin;
+    result.lightSampleDataBuffer = data->options.sampleDataBuffer;
+    result.series = &data->series;
+    result.lightSampleRadius = data->options.sampleRegionSize;
+    result.sobolDiskPoints = data->sobolDiskPoints;
+    result.shadowMaps = data->shadowMaps;
+    result.visibilityCache = data->visibilityCache;
+    result.stats = &data->stats;
+    result.throughputCutoff = data->options.throughputCutoff;
+    result.russianRoulette = data->options.russianRoulette;
+    result.diffuseBounce = data->options.diffuseBounce;
+    
+    return result;
 }
 
-static void RayTraceSectionRow(RayTraceSectionRowData* dataPointer) {
-    RayTraceSectionRowData data = *dataPointer;
+static void RayTraceTile(RayTraceThreadData* dataPointer, RenderTile tile) {
+    RayTraceThreadData& data = *dataPointer;
     Options options = data.options;
     SAAData saaData = data.saaData;
-    U32 rowYEnd = data.rowYStart + data.rowHeight;
+    U32 rowYEnd = tile.y + tile.height;
+    U32 rowXEnd = tile.x + tile.width;
     
-    for(U32 rowY = data.rowYStart; rowY < rowYEnd; ++rowY) {
+    ShadingData shading = GetShadingData(&data);
+    
+    for(U32 rowY = tile.y; rowY < rowYEnd; ++rowY) {
         F32 viewPortY = - 1 + 2 * ((F32)rowY / (F32)data.imageHeight);
         
-        for(U32 rowX = 0; rowX < data.rowWidth; ++rowX) {
-            F32 viewPortX = - 1 + 2 * ((F32)rowX / (F32)data.rowWidth);
+        for(U32 rowX = tile.x; rowX < rowXEnd; ++rowX) {
+            F32 viewPortX = - 1 + 2 * ((F32)rowX / (F32)data.imageWidth);
             
             V3 filmXOffset = data.cameraX * (viewPortX * data.filmWidthHalf);
             V3 filmYOffset = data.cameraY * (viewPortY * data.filmHeightHalf);
             
             V3 filmP = data.filmC + filmXOffset + filmYOffset;
             
+            U64 pixelStartTicks = data.pixelCostData ? GetCPUTicks() : 0;
             V3 pixel = {};
             
             switch(options.saaMode) {
                 case(SAAMode_None): {
-                    V3 rayOrigin = data.cameraP;
+                    BeginSample(&data, rowX, rowY, 0);
+                    
                     V3 rayDirection = Normalize(filmP - data.cameraP);
                     
-                    pixel = CalculateColor(rayOrigin, rayDirection,
-                                           data.world,
-                                           options.samplesPerShading, options.sampleDataBuffer,
-                                           0, U32_MAX,
-                                           &data.series,
-                                           data.randomCirclePoints,
-                                           data.randomCirclePointCount);
+                    ShootRayResult result = TracePrimarySample(&data, rayDirection, rowX, rowY, 0, 1);
+                    pixel = ShadeHit(result, rayDirection,
+                                     data.world,
+                                     0, U32_MAX,
+                                     &shading);
                 } break;
                 case(SAAMode_SSAA): {
-                    PixelSamplingPoints samplingPoints = CalculatePixelSamplingPoints(filmP, 
-                                                                                      saaData.sampleRegionX, saaData.sampleRegionY, 
-                                                                                      options.samplesToTake, options.samplesPerDim);
-                    
-                    V3Array_64 sampels;
-                    for(U32 sampleIndex = 0; sampleIndex < samplingPoints.count; ++sampleIndex) {
-                        V3 samplePoint = samplingPoints.points[sampleIndex];
+                    //Average Filter
+                    F32 contribution = 1.0f / options.samplesToTake;
+                    for(U32 sampleIndex = 0; sampleIndex < options.samplesToTake; ++sampleIndex) {
+                        V3 samplePoint = CalculatePixelSamplingPoint(filmP, 
+                                                                     saaData.sampleRegionX, saaData.sampleRegionY, 
+                                                                     options.samplesPerDim, sampleIndex);
+                        
+                        BeginSample(&data, rowX, rowY, sampleIndex);
                         
-                        V3 rayOrigin = data.cameraP;
                         V3 rayDirection = Normalize(samplePoint - data.cameraP);
                         
-                        V3 traceResult = CalculateColor(rayOrigin, rayDirection,
-                                                        data.world,
-                                                        options.samplesPerShading, options.sampleDataBuffer,
-                                                        0, U32_MAX,
-                                                        &data.series,
-                                                        data.randomCirclePoints,
-                                                        data.randomCirclePointCount);
+                        ShootRayResult result = TracePrimarySample(&data, rayDirection,
+                                                                   rowX, rowY, sampleIndex, options.samplesToTake);
+                        V3 traceResult = ShadeHit(result, rayDirection,
+                                                  data.world,
+                                                  0, U32_MAX,
+                                                  &shading);
                         
-                        sampels[sampleIndex] = traceResult;
+                        pixel = pixel + (traceResult * contribution);
                     }
+                } break;
+                case(SAAMode_Adaptive): {
+                    pixel = RayTracePixelAdaptive(&data, &shading, rowX, rowY, filmP);
+                } break;
+                case(SAAMode_MSAA): {
+                    ShootRayResult results[MSAA_MAX_SAMPLES];
+                    V3 rayDirections[MSAA_MAX_SAMPLES];
                     
-                    //Average Filter
-                    F32 contribution = 1.0f / samplingPoints.count;
-                    for(U32 sampleIndex = 0;
-                        sampleIndex < options.samplesToTake;
-                        sampleIndex++) {
-                        pixel = pixel + (sampels[sampleIndex] * contribution);
+                    for(U32 sampleIndex = 0; sampleIndex < options.samplesToTake; ++sampleIndex) {
+                        V3 samplePoint = CalculatePixelSamplingPoint(filmP, 
+                                                                     saaData.sampleRegionX, saaData.sampleRegionY, 
+                                                                     options.samplesPerDim, sampleIndex);
+                        
+                        rayDirections[sampleIndex] = Normalize(samplePoint - data.cameraP);
+                        results[sampleIndex] = TracePrimarySample(&data, rayDirections[sampleIndex],
+                                                                  rowX, rowY, sampleIndex, options.samplesToTake);
                     }
                     
+                    pixel = ShadePixelMultisample(&data, &shading, rowX, rowY,
+                                                  results, rayDirections, options.samplesToTake);
                 } break;
             }
             
-            U32 pixelIndex = rowY * data.rowWidth + rowX;
-            data.packedPixelData[pixelIndex] = PackColor(pixel);
+            U32 pixelIndex = (rowY - data.pixelRowOffset) * data.imageWidth + rowX;
+            data.hdrPixelData[pixelIndex] = pixel;
+            
+            if(data.pixelCostData) {
+                data.pixelCostData[pixelIndex] = (F32)(GetCPUTicks() - pixelStartTicks);
+            }
+        }
+    }
+}
+
+static void RayTracePrimaryPacket(RayPacket* packet, World* world, ShootRayResult* results, RayTraceStats* stats) {
+    V3 rayOrigin = packet->origin;
+    
+    if(IsPacketCoherent(packet)) {
+        RayTracePacket(packet, world, stats);
+        
+        for(U32 rayIndex = 0; rayIndex < packet->rayCount; ++rayIndex) {
+            V3 rayDirection = {packet->directionX[rayIndex], packet->directionY[rayIndex], packet->directionZ[rayIndex]};
+            
+            ShootRayResult result = {};
+            ResolveHit(rayOrigin, rayDirection,
+                       world,
+                       packet->hitDistance[rayIndex], 
+                       packet->hitPlaneIndex[rayIndex], packet->hitSphereIndex[rayIndex],
+                       &result);
+            
+            results[rayIndex] = result;
+        }
+    } else {
+        for(U32 rayIndex = 0; rayIndex < packet->rayCount; ++rayIndex) {
+            V3 rayDirection = {packet->directionX[rayIndex], packet->directionY[rayIndex], packet->directionZ[rayIndex]};
+            
+            ShootRayResult result = {};
+            RayTraceObjects(rayOrigin, rayDirection,
+                            world,
+                            F32_MAX,
+                            &result,
+                            stats);
+            
+            results[rayIndex] = result;
+        }
+    }
+}
+
+//NOTE(ans): 
+// same image as RayTraceTile, but the primary rays of a packetDim x packetDim block are traced 
+// as one packet before any of them gets shaded
+static void RayTraceTilePackets(RayTraceThreadData* dataPointer, RenderTile tile) {
+    RayTraceThreadData& data = *dataPointer;
+    Options options = data.options;
+    SAAData saaData = data.saaData;
+    U32 packetDim = options.packetDim;
+    U32 rowYEnd = tile.y + tile.height;
+    U32 rowXEnd = tile.x + tile.width;
+    
+    ShadingData shading = GetShadingData(&data);
+    
+    U32 samplesPerPixel = GetSamplesPerPixel(&options);
+    
+    RayPacket packet;
+    packet.origin = data.cameraP;
+    ShootRayResult results[RAY_PACKET_MAX_RAYS];
+    
+    for(U32 blockY = tile.y; blockY < rowYEnd; blockY += packetDim) {
+        U32 blockYEnd = blockY + packetDim;
+        if(blockYEnd > rowYEnd) {
+            blockYEnd = rowYEnd;
+        }
+        
+        for(U32 blockX = tile.x; blockX < rowXEnd; blockX += packetDim) {
+            U32 blockXEnd = blockX + packetDim;
+            if(blockXEnd > rowXEnd) {
+                blockXEnd = rowXEnd;
+            }
+            
+            packet.rayCount = 0;
+            for(U32 rowY = blockY; rowY < blockYEnd; ++rowY) {
+                F32 viewPortY = - 1 + 2 * ((F32)rowY / (F32)data.imageHeight);
+                
+                for(U32 rowX = blockX; rowX < blockXEnd; ++rowX) {
+                    F32 viewPortX = - 1 + 2 * ((F32)rowX / (F32)data.imageWidth);
+                    
+                    V3 filmXOffset = data.cameraX * (viewPortX * data.filmWidthHalf);
+                    V3 filmYOffset = data.cameraY * (viewPortY * data.filmHeightHalf);
+                    
+                    V3 filmP = data.filmC + filmXOffset + filmYOffset;
+                    
+                    for(U32 sampleIndex = 0; sampleIndex < samplesPerPixel; ++sampleIndex) {
+                        V3 samplePoint = filmP;
+                        if(options.saaMode != SAAMode_None) {
+                            samplePoint = CalculatePixelSamplingPoint(filmP, 
+                                                                      saaData.sampleRegionX, saaData.sampleRegionY, 
+                                                                      options.samplesPerDim, sampleIndex);
+                        }
+                        
+                        V3 rayDirection = Normalize(samplePoint - data.cameraP);
+                        
+                        packet.directionX[packet.rayCount] = rayDirection.x;
+                        packet.directionY[packet.rayCount] = rayDirection.y;
+                        packet.directionZ[packet.rayCount] = rayDirection.z;
+                        ++packet.rayCount;
+                    }
+                }
+            }
+            
+            U64 packetStartTicks = data.pixelCostData ? GetCPUTicks() : 0;
+            
+            RayTracePrimaryPacket(&packet, data.world, results, &data.stats);
+            data.stats.primaryRayCount += packet.rayCount;
+            
+            //NOTE(ans): the packet is traced as a whole, every pixel gets the same share of it
+            F32 packetCost = 0;
+            if(data.pixelCostData) {
+                U32 blockPixelCount = (blockYEnd - blockY) * (blockXEnd - blockX);
+                packetCost = (F32)(GetCPUTicks() - packetStartTicks) / (F32)blockPixelCount;
+            }
+            
+            //NOTE(ans): rays were added pixel by pixel, so the samples of a pixel are next to each other
+            U32 rayIndex = 0;
+            F32 contribution = 1.0f / samplesPerPixel;
+            for(U32 rowY = blockY; rowY < blockYEnd; ++rowY) {
+                for(U32 rowX = blockX; rowX < blockXEnd; ++rowX) {
+                    U64 pixelStartTicks = data.pixelCostData ? GetCPUTicks() : 0;
+                    V3 pixel = {};
+                    
+                    if(data.gBufferSamples) {
+                        GBufferSample* gBufferSamples = data.gBufferSamples + ((U64)rowY * data.imageWidth + rowX) * samplesPerPixel;
+                        
+                        for(U32 sampleIndex = 0; sampleIndex < samplesPerPixel; ++sampleIndex) {
+                            StoreGBufferSample(gBufferSamples + sampleIndex, results[rayIndex + sampleIndex]);
+                        }
+                    }
+                    
+                    if(options.saaMode == SAAMode_MSAA) {
+                        V3 rayDirections[MSAA_MAX_SAMPLES];
+                        for(U32 sampleIndex = 0; sampleIndex < samplesPerPixel; ++sampleIndex) {
+                            U32 sampleRayIndex = rayIndex + sampleIndex;
+                            rayDirections[sampleIndex] = {packet.directionX[sampleRayIndex], packet.directionY[sampleRayIndex], packet.directionZ[sampleRayIndex]};
+                        }
+                        
+                        pixel = ShadePixelMultisample(&data, &shading, rowX, rowY,
+                                                      results + rayIndex, rayDirections, samplesPerPixel);
+                        rayIndex += samplesPerPixel;
+                    } else {
+                        for(U32 sampleIndex = 0; sampleIndex < samplesPerPixel; ++sampleIndex) {
+                            V3 rayDirection = {packet.directionX[rayIndex], packet.directionY[rayIndex], packet.directionZ[rayIndex]};
+                            
+                            BeginSample(&data, rowX, rowY, sampleIndex);
+                            
+                            V3 traceResult = ShadeHit(results[rayIndex], rayDirection,
+                                                      data.world,
+                                                      0, U32_MAX,
+                                                      &shading);
+                            
+                            pixel = pixel + (traceResult * contribution);
+                            ++rayIndex;
+                        }
+                    }
+                    
+                    U32 pixelIndex = (rowY - data.pixelRowOffset) * data.imageWidth + rowX;
+                    data.hdrPixelData[pixelIndex] = pixel;
+                    
+                    if(data.pixelCostData) {
+                        data.pixelCostData[pixelIndex] = packetCost + (F32)(GetCPUTicks() - pixelStartTicks);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void RecordTileTime(RayTraceStats* stats, U64 ticks) {
+    ++stats->tileCount;
+    stats->tileTicks += ticks;
+    
+    if(ticks > stats->maxTileTicks) {
+        stats->maxTileTicks = ticks;
+    }
+}
+
+//NOTE(ans): the stages of a wavefront tile work on all of its samples at once, so its pixels share the tile time evenly
+static void SpreadTileCost(RayTraceThreadData* data, RenderTile tile, U64 ticks) {
+    F32 pixelCost = (F32)ticks / (F32)(tile.width * tile.height);
+    
+    for(U32 rowY = tile.y; rowY < tile.y + tile.height; ++rowY) {
+        F32* costRow = data->pixelCostData + (rowY - data->pixelRowOffset) * data->imageWidth;
+        
+        for(U32 rowX = tile.x; rowX < tile.x + tile.width; ++rowX) {
+            costRow[rowX] = pixelCost;
+        }
+    }
+}
+
+static void RayTraceTiles(RenderContext* context, RayTraceThreadData* data, U32 threadIndex) {
+    RenderTile tile;
+    while(NextTile(&context->scheduler, threadIndex, &tile)) {
+        U64 startTicks = GetCPUTicks();
+        
+        //NOTE(ans): reshading has no primary rays to batch, the wavefront tiles do not record their primary hits
+        if(data->reshade) {
+            RayTraceTile(data, tile);
+        } else if(data->options.wavefront && !data->gBufferSamples &&
+                  data->options.saaMode != SAAMode_Adaptive && data->options.saaMode != SAAMode_MSAA) {
+            RayTraceTileWavefront(data, tile);
+            
+            if(data->pixelCostData) {
+                SpreadTileCost(data, tile, GetCPUTicks() - startTicks);
+            }
+        } else if(data->options.packetDim && data->options.saaMode != SAAMode_Adaptive) {
+            RayTraceTilePackets(data, tile);
+        } else {
+            RayTraceTile(data, tile);
+        }
+        
+        RecordTileTime(&data->stats, GetCPUTicks() - startTicks);
+    }
+}
+
+static void RayTraceThreadJob(void* jobData, U32 threadIndex) {
+    RenderContext* context = (RenderContext*)jobData;
+    
+    //NOTE(ans): work on a local copy, the random series gets written for every sample
+    RayTraceThreadData data = context->threadData[threadIndex];
+    
+    RayTraceTiles(context, &data, threadIndex);
+    
+    context->threadData[threadIndex].stats = data.stats;
+}
+
+static void RayTraceTileProgressive(RayTraceThreadData* dataPointer, RenderTile tile) {
+    RayTraceThreadData& data = *dataPointer;
+    SAAData saaData = data.saaData;
+    U32 rowYEnd = tile.y + tile.height;
+    U32 rowXEnd = tile.x + tile.width;
+    
+    ShadingData shading = GetShadingData(&data);
+    
+    //NOTE(ans): all pixels of a pass share one sample position, the passes walk the halton sequence
+    F32 sampleU = Halton(data.passIndex + 1, 2);
+    F32 sampleV = Halton(data.passIndex + 1, 3);
+    
+    for(U32 rowY = tile.y; rowY < rowYEnd; ++rowY) {
+        F32 viewPortY = - 1 + 2 * ((F32)rowY / (F32)data.imageHeight);
+        
+        for(U32 rowX = tile.x; rowX < rowXEnd; ++rowX) {
+            F32 viewPortX = - 1 + 2 * ((F32)rowX / (F32)data.imageWidth);
+            
+            V3 filmXOffset = data.cameraX * (viewPortX * data.filmWidthHalf);
+            V3 filmYOffset = data.cameraY * (viewPortY * data.filmHeightHalf);
+            
+            V3 filmP = data.filmC + filmXOffset + filmYOffset;
+            V3 samplePoint = filmP + saaData.sampleRegionX * sampleU + saaData.sampleRegionY * sampleV;
+            
+            V3 rayOrigin = data.cameraP;
+            V3 rayDirection = Normalize(samplePoint - data.cameraP);
+            
+            U64 pixelStartTicks = data.pixelCostData ? GetCPUTicks() : 0;
+            
+            //NOTE(ans): the pass is the sample index of the pixel
+            BeginSample(&data, rowX, rowY, data.passIndex);
+            
+            V3 color = CalculateColor(rayOrigin, rayDirection,
+                                      data.world,
+                                      0, U32_MAX,
+                                      &shading);
+            
+            U32 pixelIndex = rowY * data.imageWidth + rowX;
+            data.hdrPixelData[pixelIndex] = data.hdrPixelData[pixelIndex] + color;
+            
+            //NOTE(ans): adds up over the passes like the colors
+            if(data.pixelCostData) {
+                data.pixelCostData[pixelIndex] += (F32)(GetCPUTicks() - pixelStartTicks);
+            }
         }
     }
+    
+    data.stats.primaryRayCount += tile.width * tile.height;
+}
+
+static void RayTraceProgressiveThreadJob(void* jobData, U32 threadIndex) {
+    RenderContext* context = (RenderContext*)jobData;
+    
+    RayTraceThreadData data = context->threadData[threadIndex];
+    
+    RenderTile tile;
+    while(NextTile(&context->scheduler, threadIndex, &tile)) {
+        U64 startTicks = GetCPUTicks();
+        
+        RayTraceTileProgressive(&data, tile);
+        
+        RecordTileTime(&data.stats, GetCPUTicks() - startTicks);
+    }
+    
+    //NOTE(ans): the next pass has to continue the stats instead of repeating them
+    context->threadData[threadIndex].stats = data.stats;
+}
+
+static void InitRenderContext(RenderContext* context) {
+    U32 threadCount = GetCPUCores();
+    context->threadCount = threadCount;
+    context->stats = {};
+    
+    context->threadPool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    InitThreadPool(context->threadPool, threadCount);
+    
+    InitTileScheduler(&context->scheduler, threadCount);
+    context->threadData = (RayTraceThreadData*)malloc(sizeof(RayTraceThreadData) * threadCount);
+    
+    context->sampleDataBuffers = (V3**)malloc(sizeof(V3*) * threadCount);
+    for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        context->sampleDataBuffers[threadIndex] = 0;
+    }
+    context->sampleDataCapacity = 0;
+    context->sobolDiskPoints = 0;
+    
+    context->toneMap = {};
+    BuildToneMap(&context->toneMap, ToneMapMode_Clamp, 1.0f, 0);
+    
+    context->wavefrontQueues = (WavefrontQueues*)malloc(sizeof(WavefrontQueues) * threadCount);
+    for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        context->wavefrontQueues[threadIndex] = {};
+    }
+    
+    context->gBuffer = {};
+    
+    context->shadowMaps = 0;
+    context->shadowMapCapacity = 0;
+    
+    context->visibilityCache = 0;
 }
 
-static void RayTraceImage(U32 imageHeight, U32 imageWidth,
+static void FreeRenderContext(RenderContext* context) {
+    FreeThreadPool(context->threadPool);
+    free(context->threadPool);
+    
+    FreeTileScheduler(&context->scheduler);
+    free(context->threadData);
+    
+    for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+        free(context->sampleDataBuffers[threadIndex]);
+    }
+    free(context->sampleDataBuffers);
+    free(context->sobolDiskPoints);
+    
+    for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+        FreeWavefrontQueues(context->wavefrontQueues + threadIndex);
+    }
+    free(context->wavefrontQueues);
+    
+    free(context->gBuffer.samples);
+    
+    FreeShadowMaps(context);
+    FreeVisibilityCache(context);
+}
+
+//NOTE(ans): sets up the scratch memory and thread data shared by all render modes, the tiles are up to the caller
+static void PrepareRender(RenderContext* context,
+                          U32 imageHeight, U32 imageWidth,
                           V3 cameraP, V3 cameraX, V3 cameraY,
                           F32 filmWidthHalf, F32 filmHeightHalf, V3 filmC,
                           World* world,
-                          U32* packedPixelData,
+                          V3* hdrPixelData,
+                          F32* pixelCostData,
                           Options* i_options,
                           SAAData* i_saaData) {
     
     SAAData saaData = *i_saaData;
     Options options = *i_options;
     
-    U32 cpuCores = GetCPUCores();
-    U32 rowHeight = imageHeight / cpuCores;
-    assert((rowHeight * cpuCores) == imageHeight);
+    U32 threadCount = context->threadCount;
     
-    RayTraceSectionRowData* dataList = (RayTraceSectionRowData*)malloc(sizeof(RayTraceSectionRowData) * cpuCores);
-    
-    U32 randomCirclePointCount = 516;
-    V3* randomCirclePoints = (V3*)malloc(sizeof(V3) * randomCirclePointCount);
+    if(options.saaMode == SAAMode_MSAA && options.samplesToTake > MSAA_MAX_SAMPLES) {
+        options.samplesToTake = MSAA_MAX_SAMPLES;
+    }
     
-    RandomSeries circleRandomSeries;
-    circleRandomSeries.series = rand();
-    F32 radius = options.sampleRegionSize;
-    for(U32 randomCirclePointIndex = 0;
-        randomCirclePointIndex < randomCirclePointCount; 
-        ++randomCirclePointIndex) {
+    //NOTE(ans): shrink the packet until all samples of its pixels fit
+    if(options.packetDim) {
+        U32 samplesPerPixel = GetSamplesPerPixel(&options);
         
-        F32 angle = RandUnitF32(&circleRandomSeries) * TAU;
-        F32 r = radius * SquareRoot(RandUnitF32(&circleRandomSeries));
+        while(options.packetDim > 1 && 
+              options.packetDim * options.packetDim * samplesPerPixel > RAY_PACKET_MAX_RAYS) {
+            --options.packetDim;
+        }
         
-        V3 randomPoint;
-        randomPoint.x = r * (F32)cos(angle);
-        randomPoint.y = r * (F32)sin(angle);
+        if(samplesPerPixel > RAY_PACKET_MAX_RAYS) {
+            options.packetDim = 0;
+        }
+    }
+    
+    //NOTE(ans): scratch buffers only grow, so rendering the same options again allocates nothing
+    if(options.samplesPerShading > context->sampleDataCapacity) {
+        for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+            free(context->sampleDataBuffers[threadIndex]);
+            context->sampleDataBuffers[threadIndex] = (V3*)malloc(sizeof(V3) * options.samplesPerShading);
+        }
+        context->sampleDataCapacity = options.samplesPerShading;
         
-        randomCirclePoints[randomCirclePointIndex] = randomPoint;
+        free(context->sobolDiskPoints);
+        context->sobolDiskPoints = (SobolDiskPoint*)malloc(sizeof(SobolDiskPoint) * options.samplesPerShading);
+        for(U32 pointIndex = 0; pointIndex < options.samplesPerShading; ++pointIndex) {
+            F32 angle = UnitF32(SobolSecondU32(pointIndex)) * TAU;
+            
+            SobolDiskPoint point;
+            point.u = UnitF32(SobolFirstU32(pointIndex));
+            point.cosAngle = cosf(angle);
+            point.sinAngle = sinf(angle);
+            
+            context->sobolDiskPoints[pointIndex] = point;
+        }
+    }
+    
+    ToneMap* toneMap = &context->toneMap;
+    if(toneMap->srgb != options.srgbOutput) {
+        BuildToneMap(toneMap, options.toneMapMode, options.exposure, options.srgbOutput);
     }
+    toneMap->mode = options.toneMapMode;
+    toneMap->exposure = options.exposure;
     
-    for(U32 cpuCoreIndex = 0; cpuCoreIndex < cpuCores; ++cpuCoreIndex) {
-        U32 rowYStart = rowHeight * cpuCoreIndex;
+    if(options.wavefront) {
+        U32 samplesPerPixel = GetSamplesPerPixel(&options);
         
-        RayTraceSectionRowData rowData;
+        U32 sampleCapacity = options.tileSize * options.tileSize * samplesPerPixel;
+        for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+            ReserveWavefrontQueues(context->wavefrontQueues + threadIndex, sampleCapacity, world->lightCount);
+        }
+    }
+    
+    for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        RayTraceThreadData rowData;
+        rowData.threadIndex = threadIndex;
         rowData.imageHeight = imageHeight;
-        rowData.rowHeight = rowHeight; 
-        rowData.rowWidth = imageWidth; 
-        rowData.rowYStart = rowYStart;
+        rowData.imageWidth = imageWidth;
         rowData.cameraP = cameraP; 
         rowData.cameraX = cameraX; 
         rowData.cameraY = cameraY;;
@@ -490,18 +1862,229 @@ static void RayTraceImage(U32 imageHeight, U32 imageWidth,
         rowData.world = world;
         rowData.options = options;
         rowData.saaData = saaData;
-        rowData.packedPixelData = packedPixelData;
-        rowData.series.series = rand();
-        rowData.options.sampleDataBuffer = (V3*)malloc(sizeof(V3) * rowData.options.samplesPerShading);
-        rowData.randomCirclePoints = randomCirclePoints;
-        rowData.randomCirclePointCount = randomCirclePointCount;
+        rowData.hdrPixelData = hdrPixelData;
+        rowData.pixelRowOffset = 0;
+        rowData.pixelCostData = pixelCostData;
+        rowData.series = {};
+        rowData.sobolDiskPoints = context->sobolDiskPoints;
+        rowData.options.sampleDataBuffer = context->sampleDataBuffers[threadIndex];
+        rowData.stats = {};
+        rowData.passIndex = 0;
+        rowData.wavefront = context->wavefrontQueues + threadIndex;
+        rowData.gBufferSamples = 0;
+        rowData.reshade = 0;
+        rowData.shadowMaps = 0;
+        rowData.visibilityCache = 0;
+        
+        context->threadData[threadIndex] = rowData;
+    }
+    
+    //NOTE(ans): lights can change between renders, so the maps are built again for every render
+    if(options.shadowMapSize) {
+        BuildShadowMaps(context, world, options.shadowMapSize);
+        
+        for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+            context->threadData[threadIndex].shadowMaps = context->shadowMaps;
+        }
+    }
+    
+    //NOTE(ans): same for the visibility cache, its entries belong to the lights and the camera of this render
+    if(options.visibilityCacheSize) {
+        ClearVisibilityCache(context, world, cameraP, &options);
+        
+        for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+            context->threadData[threadIndex].visibilityCache = context->visibilityCache;
+        }
+    }
+    
+    //NOTE(ans): RayTraceImage records again when it caches the primary hits, every other render overwrites the setup they belong to
+    context->gBuffer.recorded = false;
+}
+
+static void AddRayTraceStats(RayTraceStats* stats, RayTraceStats add) {
+    stats->lightShadingCount += add.lightShadingCount;
+    stats->shadowRayCount += add.shadowRayCount;
+    stats->penumbraCount += add.penumbraCount;
+    stats->primaryRayCount += add.primaryRayCount;
+    stats->reflectionRayCount += add.reflectionRayCount;
+    stats->boxTestCount += add.boxTestCount;
+    stats->primitiveTestCount += add.primitiveTestCount;
+    stats->tileCount += add.tileCount;
+    stats->tileTicks += add.tileTicks;
+    stats->shadowMapSampleCount += add.shadowMapSampleCount;
+    stats->shadowMapRayCount += add.shadowMapRayCount;
+    stats->visibilityCacheShadingCount += add.visibilityCacheShadingCount;
+    stats->visibilityCacheEntryCount += add.visibilityCacheEntryCount;
+    
+    if(add.maxTileTicks > stats->maxTileTicks) {
+        stats->maxTileTicks = add.maxTileTicks;
+    }
+}
+
+static void CollectRenderStats(RenderContext* context) {
+    U32 threadCount = context->threadCount;
+    
+    RayTraceStats stats = {};
+    for(U32 threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        AddRayTraceStats(&stats, context->threadData[threadIndex].stats);
+    }
+    context->stats = stats;
+}
+
+static double PerSecond(U64 count, U64 microseconds) {
+    double result = 0;
+    if(microseconds) {
+        result = (double)count * 1000000.0 / (double)microseconds;
+    }
+    
+    return result;
+}
+
+//NOTE(ans): microseconds is the wall clock time of the render the stats were collected in
+static void PrintRayStats(RayTraceStats stats, U64 microseconds, U64 pixelCount) {
+    U64 rayCount = stats.primaryRayCount + stats.shadowRayCount + stats.reflectionRayCount;
+    
+    printf("Rays:         %llu total, %.2f M/s\n", 
+           rayCount, PerSecond(rayCount, microseconds) / 1000000.0);
+    printf("  Primary:    %llu (%.2f per pixel), %.2f M/s\n", 
+           stats.primaryRayCount, (double)stats.primaryRayCount / (double)pixelCount,
+           PerSecond(stats.primaryRayCount, microseconds) / 1000000.0);
+    if(stats.lightShadingCount) {
+        printf("  Shadow:     %llu (%.1f per light and hit), %.2f M/s\n", 
+               stats.shadowRayCount, (double)stats.shadowRayCount / (double)stats.lightShadingCount,
+               PerSecond(stats.shadowRayCount, microseconds) / 1000000.0);
+        printf("  Penumbra:   %llu of %llu light and hit pairs\n", 
+               stats.penumbraCount, stats.lightShadingCount);
+    }
+    if(stats.shadowMapRayCount) {
+        printf("  Shadow map: %llu light samples looked up, %llu rays to build the maps\n", 
+               stats.shadowMapSampleCount, stats.shadowMapRayCount);
+    }
+    if(stats.visibilityCacheEntryCount) {
+        printf("  Visibility: %llu light and hit pairs from the cache, %llu entries traced\n", 
+               stats.visibilityCacheShadingCount, stats.visibilityCacheEntryCount);
+    }
+    printf("  Reflection: %llu, %.2f M/s\n", 
+           stats.reflectionRayCount, PerSecond(stats.reflectionRayCount, microseconds) / 1000000.0);
+    
+    if(rayCount) {
+        printf("Box tests:    %llu (%.1f per ray)\n", 
+               stats.boxTestCount, (double)stats.boxTestCount / (double)rayCount);
+        printf("Object tests: %llu (%.1f per ray)\n", 
+               stats.primitiveTestCount, (double)stats.primitiveTestCount / (double)rayCount);
+    }
+    
+    double ticksPerMillisecond = (double)GetCPUFrequency() / 1000.0;
+    if(stats.tileCount) {
+        printf("Tiles:        %llu, %.3f ms average, %.3f ms slowest\n", 
+               stats.tileCount, 
+               (double)stats.tileTicks / (double)stats.tileCount / ticksPerMillisecond,
+               (double)stats.maxTileTicks / ticksPerMillisecond);
+    }
+}
+
+//NOTE(ans): the threads show how evenly the tiles were spread, busy is the time they spent inside tiles
+static void PrintRenderReport(RenderContext* context, U64 microseconds, U64 pixelCount) {
+    PrintRayStats(context->stats, microseconds, pixelCount);
+    
+    double ticksPerMillisecond = (double)GetCPUFrequency() / 1000.0;
+    for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+        RayTraceStats threadStats = context->threadData[threadIndex].stats;
+        U64 threadRayCount = threadStats.primaryRayCount + threadStats.shadowRayCount + threadStats.reflectionRayCount;
+        
+        printf("  Thread %2lu:  %llu tiles, %.1f ms busy, %llu rays\n", 
+               threadIndex, threadStats.tileCount, 
+               (double)threadStats.tileTicks / ticksPerMillisecond, threadRayCount);
+    }
+}
+
+struct ToneMapJob {
+    ToneMap* toneMap;
+    V3* hdrPixels;
+    U32* packedPixels;
+    U64 pixelCount;
+    F32 scale;
+    U32 threadCount;
+};
+
+static void ToneMapThreadJob(void* jobData, U32 threadIndex) {
+    ToneMapJob* job = (ToneMapJob*)jobData;
+    
+    U64 firstPixel = job->pixelCount * threadIndex / job->threadCount;
+    U64 endPixel = job->pixelCount * (threadIndex + 1) / job->threadCount;
+    
+    ToneMapPixels(job->toneMap,
+                  job->hdrPixels + firstPixel,
+                  job->packedPixels + firstPixel,
+                  (size_t)(endPixel - firstPixel),
+                  job->scale);
+}
+
+//NOTE(ans): 
+// packs the linear render into the bmp pixels with the tone map of the last PrepareRender.
+// cheap enough to run again with a different exposure without rendering anything
+static void ToneMapImage(RenderContext* context, V3* hdrPixels, U32* packedPixels, U64 pixelCount, F32 scale) {
+    ToneMapJob job;
+    job.toneMap = &context->toneMap;
+    job.hdrPixels = hdrPixels;
+    job.packedPixels = packedPixels;
+    job.pixelCount = pixelCount;
+    job.scale = scale;
+    job.threadCount = context->threadCount;
+    
+    RunThreadPool(context->threadPool, ToneMapThreadJob, &job);
+}
+
+static void RayTraceImage(RenderContext* context,
+                          U32 imageHeight, U32 imageWidth,
+                          V3 cameraP, V3 cameraX, V3 cameraY,
+                          F32 filmWidthHalf, F32 filmHeightHalf, V3 filmC,
+                          World* world,
+                          V3* hdrPixelData,
+                          F32* pixelCostData,
+                          Options* options,
+                          SAAData* saaData) {
+    PrepareRender(context,
+                  imageHeight, imageWidth,
+                  cameraP, cameraX, cameraY,
+                  filmWidthHalf, filmHeightHalf, filmC,
+                  world,
+                  hdrPixelData,
+                  pixelCostData,
+                  options,
+                  saaData);
+    
+    GBuffer* gBuffer = &context->gBuffer;
+    bool recordPrimaryHits = options->cachePrimaryHits && options->saaMode != SAAMode_Adaptive;
+    if(recordPrimaryHits) {
+        //NOTE(ans): the options of the thread data, PrepareRender may have limited the samples
+        U32 samplesPerPixel = GetSamplesPerPixel(&context->threadData[0].options);
+        
+        U64 sampleCount = (U64)imageWidth * (U64)imageHeight * samplesPerPixel;
+        if(sampleCount > gBuffer->sampleCapacity) {
+            free(gBuffer->samples);
+            gBuffer->samples = (GBufferSample*)malloc(sizeof(GBufferSample) * sampleCount);
+            gBuffer->sampleCapacity = sampleCount;
+        }
         
-        dataList[cpuCoreIndex] = rowData;
+        gBuffer->saaMode = options->saaMode;
+        gBuffer->samplesPerPixel = samplesPerPixel;
+        gBuffer->samplesPerDim = options->samplesPerDim;
+        
+        for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+            context->threadData[threadIndex].gBufferSamples = gBuffer->samples;
+        }
     }
     
-    CreateMultipleThreadsAndWait((ThreadFunction)RayTraceSectionRow, 
-                                 dataList,
-                                 cpuCores);
+    ResetTileScheduler(&context->scheduler,
+                       imageWidth, imageHeight,
+                       options->tileSize);
+    
+    RunThreadPool(context->threadPool, RayTraceThreadJob, context);
+    
+    CollectRenderStats(context);
+    
+    gBuffer->recorded = recordPrimaryHits;
     
 #if 0        
     if((imageY % 64) == 0) { 
@@ -510,4 +2093,281 @@ static void RayTraceImage(U32 imageHeight, U32 imageWidth,
         fflush(stdout); d
     }
 #endif
-}
\ No newline at end of file
+}
+
+//NOTE(ans): 
+// shades the primary hits the last RayTraceImage recorded with cachePrimaryHits again, for look dev
+// when only lights or materials change. the world has to keep its geometry, camera and image size
+// stay the ones of the recorded render. returns false when the sampling differs from the recording,
+// the image then has to be rendered with RayTraceImage
+static bool ReshadeImage(RenderContext* context,
+                         World* world,
+                         V3* hdrPixelData,
+                         F32* pixelCostData,
+                         Options* options) {
+    GBuffer* gBuffer = &context->gBuffer;
+    
+    U32 samplesPerPixel = GetSamplesPerPixel(options);
+    if(options->saaMode == SAAMode_MSAA && samplesPerPixel > MSAA_MAX_SAMPLES) {
+        samplesPerPixel = MSAA_MAX_SAMPLES;
+    }
+    
+    if(!gBuffer->recorded ||
+       gBuffer->saaMode != options->saaMode ||
+       gBuffer->samplesPerPixel != samplesPerPixel ||
+       (options->saaMode != SAAMode_None && gBuffer->samplesPerDim != options->samplesPerDim)) {
+        return false;
+    }
+    
+    RayTraceThreadData recorded = context->threadData[0];
+    
+    PrepareRender(context,
+                  recorded.imageHeight, recorded.imageWidth,
+                  recorded.cameraP, recorded.cameraX, recorded.cameraY,
+                  recorded.filmWidthHalf, recorded.filmHeightHalf, recorded.filmC,
+                  world,
+                  hdrPixelData,
+                  pixelCostData,
+                  options,
+                  &recorded.saaData);
+    
+    for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+        context->threadData[threadIndex].gBufferSamples = gBuffer->samples;
+        context->threadData[threadIndex].reshade = 1;
+    }
+    
+    ResetTileScheduler(&context->scheduler,
+                       recorded.imageWidth, recorded.imageHeight,
+                       options->tileSize);
+    
+    RunThreadPool(context->threadPool, RayTraceThreadJob, context);
+    
+    CollectRenderStats(context);
+    
+    gBuffer->recorded = true;
+    
+    return true;
+}
+
+//NOTE(ans): 
+// renders rows regionY to regionY + rowCount into regionPixelData after PrepareRender,
+// the stats only cover this region. distributed workers render their bands with it
+static void RayTraceRegion(RenderContext* context,
+                           U32 imageWidth, U32 regionY, U32 rowCount,
+                           V3* regionPixelData) {
+    for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+        RayTraceThreadData* threadData = context->threadData + threadIndex;
+        threadData->hdrPixelData = regionPixelData;
+        threadData->pixelRowOffset = regionY;
+        threadData->stats = {};
+    }
+    
+    ResetTileSchedulerRegion(&context->scheduler,
+                             imageWidth, regionY, rowCount,
+                             context->threadData[0].options.tileSize);
+    
+    RunThreadPool(context->threadPool, RayTraceThreadJob, context);
+    
+    CollectRenderStats(context);
+}
+
+//NOTE(ans): 
+// every pass adds one sample per pixel to hdrPixelData and the snapshots pack the running average,
+// the image gets written every progressiveSnapshotSeconds so the render can be watched and stopped
+// as soon as it looks good enough. hdrPixelData holds the average after the last pass
+static void RayTraceImageProgressive(RenderContext* context,
+                                     U32 imageHeight, U32 imageWidth,
+                                     V3 cameraP, V3 cameraX, V3 cameraY,
+                                     F32 filmWidthHalf, F32 filmHeightHalf, V3 filmC,
+                                     World* world,
+                                     V3* hdrPixelData,
+                                     F32* pixelCostData,
+                                     BMP_Image* image, char* fileName,
+                                     Options* options,
+                                     SAAData* saaData) {
+    U64 pixelCount = (U64)imageWidth * (U64)imageHeight;
+    for(U64 pixelIndex = 0; pixelIndex < pixelCount; ++pixelIndex) {
+        hdrPixelData[pixelIndex] = {};
+    }
+    
+    if(pixelCostData) {
+        for(U64 pixelIndex = 0; pixelIndex < pixelCount; ++pixelIndex) {
+            pixelCostData[pixelIndex] = 0;
+        }
+    }
+    
+    PrepareRender(context,
+                  imageHeight, imageWidth,
+                  cameraP, cameraX, cameraY,
+                  filmWidthHalf, filmHeightHalf, filmC,
+                  world,
+                  hdrPixelData,
+                  pixelCostData,
+                  options,
+                  saaData);
+    
+    U64 snapshotInterval = (U64)options->progressiveSnapshotSeconds * 1000000;
+    U64 lastSnapshot = GetTimeStamp();
+    
+    U32 passCount = options->progressivePasses;
+    for(U32 passIndex = 0; passIndex < passCount; ++passIndex) {
+        for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+            context->threadData[threadIndex].passIndex = passIndex;
+        }
+        
+        //NOTE(ans): the tiles only get built on the first pass, after that this only refills the queues
+        ResetTileScheduler(&context->scheduler,
+                           imageWidth, imageHeight,
+                           options->tileSize);
+        
+        RunThreadPool(context->threadPool, RayTraceProgressiveThreadJob, context);
+        
+        U64 now = GetTimeStamp();
+        bool lastPass = passIndex + 1 == passCount;
+        if(lastPass || now - lastSnapshot >= snapshotInterval) {
+            ToneMapImage(context, hdrPixelData, GetPackedPixelData(image), pixelCount, 1.0f / (F32)(passIndex + 1));
+            WriteBMPImage(image, fileName);
+            lastSnapshot = now;
+            
+            printf("\rPass %lu of %lu written to %s ", passIndex + 1, passCount, fileName);
+            fflush(stdout);
+        }
+    }
+    printf("\n");
+    
+    F32 contribution = 1.0f / (F32)passCount;
+    for(U64 pixelIndex = 0; pixelIndex < pixelCount; ++pixelIndex) {
+        hdrPixelData[pixelIndex] = hdrPixelData[pixelIndex] * contribution;
+    }
+    
+    CollectRenderStats(context);
+}
+
+struct StreamedRenderJob {
+    RenderContext* context;
+    ImageStream* stream;
+    ImageStream* floatStream;
+    
+    //NOTE(ans): band finished by the last run, gets packed and written while the next band renders
+    V3* writeRows;
+    U32 writeRowCount;
+    U32* packedRows;
+};
+
+static void RayTraceStreamedThreadJob(void* jobData, U32 threadIndex) {
+    StreamedRenderJob* job = (StreamedRenderJob*)jobData;
+    RenderContext* context = job->context;
+    
+    //NOTE(ans): the other threads steal the tiles of thread 0 while it writes
+    if(threadIndex == 0 && job->writeRowCount) {
+        ToneMapPixels(&context->toneMap,
+                      job->writeRows, job->packedRows,
+                      (size_t)job->stream->width * (size_t)job->writeRowCount,
+                      1.0f);
+        WriteBMPStreamRows(job->stream, job->packedRows, job->writeRowCount);
+        
+        if(job->floatStream) {
+            WritePFMStreamRows(job->floatStream, job->writeRows, job->writeRowCount);
+        }
+    }
+    
+    RayTraceThreadData data = context->threadData[threadIndex];
+    
+    RayTraceTiles(context, &data, threadIndex);
+    
+    //NOTE(ans): the next band has to continue the stats
+    context->threadData[threadIndex].stats = data.stats;
+}
+
+//NOTE(ans): 
+// renders the image in bands of whole tile rows and streams every finished band to the file,
+// only two bands are ever in memory. writing a band overlaps with rendering the next one.
+// the samples seed their own random series, so the bands come out as RayTraceImage renders them
+static void RayTraceImageStreamed(RenderContext* context,
+                                  U32 imageHeight, U32 imageWidth,
+                                  V3 cameraP, V3 cameraX, V3 cameraY,
+                                  F32 filmWidthHalf, F32 filmHeightHalf, V3 filmC,
+                                  World* world,
+                                  char* fileName, char* floatFileName,
+                                  Options* options,
+                                  SAAData* saaData) {
+    ImageStream stream;
+    if(!BeginBMPStream(&stream, fileName, imageWidth, imageHeight)) {
+        return;
+    }
+    
+    ImageStream floatStream;
+    bool writeFloat = options->saveFloatImage && BeginPFMStream(&floatStream, floatFileName, imageWidth, imageHeight);
+    
+    //NOTE(ans): enough tiles per band that stealing can even out the threads before the next band starts
+    U32 tileSize = options->tileSize;
+    U32 tilesX = (imageWidth + tileSize - 1) / tileSize;
+    U32 bandTileRows = (8 * context->threadCount + tilesX - 1) / tilesX;
+    U32 bandHeight = bandTileRows * tileSize;
+    
+    size_t bandPixelCount = (size_t)bandHeight * (size_t)imageWidth;
+    V3* bands[2];
+    bands[0] = (V3*)malloc(sizeof(V3) * bandPixelCount);
+    bands[1] = (V3*)malloc(sizeof(V3) * bandPixelCount);
+    U32* packedRows = (U32*)malloc(sizeof(U32) * bandPixelCount);
+    
+    PrepareRender(context,
+                  imageHeight, imageWidth,
+                  cameraP, cameraX, cameraY,
+                  filmWidthHalf, filmHeightHalf, filmC,
+                  world,
+                  bands[0],
+                  0,
+                  options,
+                  saaData);
+    
+    StreamedRenderJob job;
+    job.context = context;
+    job.stream = &stream;
+    job.floatStream = writeFloat ? &floatStream : 0;
+    job.writeRows = 0;
+    job.writeRowCount = 0;
+    job.packedRows = packedRows;
+    
+    U32 bandIndex = 0;
+    for(U32 bandY = 0; bandY < imageHeight; bandY += bandHeight, ++bandIndex) {
+        U32 rowCount = imageHeight - bandY;
+        if(rowCount > bandHeight) {
+            rowCount = bandHeight;
+        }
+        
+        V3* band = bands[bandIndex & 1];
+        for(U32 threadIndex = 0; threadIndex < context->threadCount; ++threadIndex) {
+            context->threadData[threadIndex].hdrPixelData = band;
+            context->threadData[threadIndex].pixelRowOffset = bandY;
+        }
+        
+        ResetTileSchedulerRegion(&context->scheduler,
+                                 imageWidth, bandY, rowCount,
+                                 tileSize);
+        
+        RunThreadPool(context->threadPool, RayTraceStreamedThreadJob, &job);
+        
+        job.writeRows = band;
+        job.writeRowCount = rowCount;
+        
+        printf("\rRows %lu of %lu rendered ", bandY + rowCount, imageHeight);
+        fflush(stdout);
+    }
+    printf("\n");
+    
+    ToneMapPixels(&context->toneMap, job.writeRows, packedRows, (size_t)imageWidth * (size_t)job.writeRowCount, 1.0f);
+    WriteBMPStreamRows(&stream, packedRows, job.writeRowCount);
+    EndImageStream(&stream);
+    
+    if(writeFloat) {
+        WritePFMStreamRows(&floatStream, job.writeRows, job.writeRowCount);
+        EndImageStream(&floatStream);
+    }
+    
+    free(bands[0]);
+    free(bands[1]);
+    free(packedRows);
+    
+    CollectRenderStats(context);
+}
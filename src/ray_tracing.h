@@ -1,18 +1,89 @@
 enum SAAMode {
     SAAMode_None,
-    SAAMode_SSAA
+    SAAMode_SSAA,
+    SAAMode_Adaptive,
+    //NOTE(ans): samples like SAAMode_SSAA, but shades every object hit in the pixel only once
+    SAAMode_MSAA
 };
 
+//NOTE(ans): SAAMode_MSAA keeps the hits of all samples of a pixel on the stack
+#define MSAA_MAX_SAMPLES 64
+
+#define REFLECTION_MAX_DEPTH 8
+
 struct Options {
     // Anti Aliasing
     SAAMode saaMode;
     U32 samplesToTake;
     U32 samplesPerDim;
+    //NOTE(ans): SAAMode_Adaptive takes samplesToTake per round up to samplesMax
+    U32 samplesMax;
+    F32 sampleVarianceThreshold;
     
     // Soft Shadow
     U32 samplesPerShading;
+    //NOTE(ans): 0 always traces all samplesPerShading rays
+    U32 samplesPerShadingPilot;
+    //NOTE(ans): radius of the disk the light samples are spread over
     F32 sampleRegionSize;
     V3* sampleDataBuffer;
+    //NOTE(ans): 
+    // texels per side of the map every directional light gets, 0 traces all of its shadow rays.
+    // other sizes are clamped to SHADOW_MAP_MIN_SIZE and SHADOW_MAP_MAX_SIZE
+    U32 shadowMapSize;
+    //NOTE(ans): entries of the soft shadow cache of the planes, 0 traces the shadow rays of every plane hit
+    U32 visibilityCacheSize;
+    //NOTE(ans): distance between the cached points close to the camera, further away it doubles per level
+    F32 visibilityCacheSpacing;
+    
+    // Reflections
+    //NOTE(ans): paths with less weight than throughputCutoff stop, russianRoulette stops them randomly instead
+    F32 throughputCutoff;
+    U32 russianRoulette;
+    U32 diffuseBounce;
+    
+    // Shading Budget
+    //NOTE(ans): most light samples a hit gets after that many bounces, 0 leaves it at samplesPerShading
+    U32 samplesPerShadingAtDepth[REFLECTION_MAX_DEPTH + 1];
+    //NOTE(ans): 0 keeps the depth caps only, otherwise a hit takes samplesPerShading * its weight on the pixel but at least this many
+    U32 samplesPerShadingMin;
+    
+    // Sampling
+    //NOTE(ans): every sample seeds its random series from its pixel, sample index, frameIndex and randomSeed
+    U32 randomSeed;
+    U32 frameIndex;
+    
+    // Scheduling
+    U32 tileSize;
+    
+    // Packets
+    //NOTE(ans): 0 traces every primary ray on its own
+    U32 packetDim;
+    
+    // Wavefront
+    //NOTE(ans): traces every tile stage by stage in sorted ray queues, SAAMode_Adaptive and SAAMode_MSAA stay depth first
+    U32 wavefront;
+    
+    // Incremental
+    //NOTE(ans): keeps the primary hit of every sample so ReshadeImage can shade them again, not for SAAMode_Adaptive
+    U32 cachePrimaryHits;
+    
+    // Progressive
+    //NOTE(ans): used by RayTraceImageProgressive, every pass adds one sample per pixel
+    U32 progressivePasses;
+    U32 progressiveSnapshotSeconds;
+    
+    // Output
+    //NOTE(ans): used by RayTraceImageStreamed, finished rows go to the file while the rest renders
+    U32 streamOutput;
+    //NOTE(ans): the render stays linear, these only change how it gets packed to 8 bit
+    ToneMapMode toneMapMode;
+    F32 exposure;
+    U32 srgbOutput;
+    //NOTE(ans): also writes the linear colors as a float image
+    U32 saveFloatImage;
+    //NOTE(ans): also writes the time spent on every pixel as a heatmap, not for streamed renders
+    U32 saveCostImage;
 };
 
 struct ShootRayResult {
@@ -26,6 +97,27 @@ struct ShootRayResult {
     char* hitName;
 };
 
+//NOTE(ans): 
+// primary rays of a packetDim x packetDim pixel block with all of their ssaa samples,
+// directions are stored as lanes, the origin is the camera for all of them
+#define RAY_PACKET_MAX_RAYS 256
+
+struct RayPacket {
+    U32 rayCount;
+    V3 origin;
+    
+    F32 directionX[RAY_PACKET_MAX_RAYS];
+    F32 directionY[RAY_PACKET_MAX_RAYS];
+    F32 directionZ[RAY_PACKET_MAX_RAYS];
+    F32 inverseDirectionX[RAY_PACKET_MAX_RAYS];
+    F32 inverseDirectionY[RAY_PACKET_MAX_RAYS];
+    F32 inverseDirectionZ[RAY_PACKET_MAX_RAYS];
+    
+    F32 hitDistance[RAY_PACKET_MAX_RAYS];
+    U32 hitPlaneIndex[RAY_PACKET_MAX_RAYS];
+    U32 hitSphereIndex[RAY_PACKET_MAX_RAYS];
+};
+
 struct RayTraceData {
     U32 imageHeight;
 };
@@ -36,21 +128,102 @@ struct SAAData {
     V3 sampleRegionY;
 };
 
-struct V3Array_64{
-    inline V3& operator[](U32 i) { return values[i]; }
-    V3 values[64];
+//NOTE(ans): every thread counts into its own copy, they get summed up after the render
+struct RayTraceStats {
+    U64 lightShadingCount;
+    U64 shadowRayCount;
+    U64 penumbraCount;
+    U64 primaryRayCount;
+    U64 reflectionRayCount;
+    
+    //NOTE(ans): ray against box and ray against plane or sphere pairs, lanes count one test each
+    U64 boxTestCount;
+    U64 primitiveTestCount;
+    
+    //NOTE(ans): in GetCPUTicks, maxTileTicks is the slowest single tile
+    U64 tileCount;
+    U64 tileTicks;
+    U64 maxTileTicks;
+    
+    //NOTE(ans): light samples the shadow maps answered without a shadow ray, and the rays that built the maps
+    U64 shadowMapSampleCount;
+    U64 shadowMapRayCount;
+    
+    //NOTE(ans): light shadings the visibility cache answered, and the cache entries traced for them
+    U64 visibilityCacheShadingCount;
+    U64 visibilityCacheEntryCount;
+};
+
+//NOTE(ans): one point of the sobol sequence in polar form, u is the squared radius on the unit disk
+struct SobolDiskPoint {
+    F32 u;
+    F32 cosAngle;
+    F32 sinAngle;
 };
 
-struct PixelSamplingPoints {
-    V3Array_64 points;
-    U32 count;
+//NOTE(ans): random shift of the sobol disk points, drawn once per light and shading point
+struct LightSampleScramble {
+    F32 shiftU;
+    F32 cosRotation;
+    F32 sinRotation;
+};
+
+struct ShadowMap;
+struct VisibilityCache;
+
+//NOTE(ans): everything the shading of a hit needs besides the world, one per thread
+struct ShadingData {
+    U32 lightSamplePointCount;
+    U32 lightPilotSampleCount;
+    //NOTE(ans): points to Options::samplesPerShadingAtDepth of the thread
+    U32* lightSampleDepthCaps;
+    U32 lightSampleMinCount;
+    V3* lightSampleDataBuffer;
+    
+    F32 lightSampleRadius;
+    SobolDiskPoint* sobolDiskPoints;
+    //NOTE(ans): one per light, 0 without shadow maps
+    ShadowMap* shadowMaps;
+    //NOTE(ans): shared by all threads, 0 without the cache
+    VisibilityCache* visibilityCache;
+    
+    RandomSeries* series;
+    
+    RayTraceStats* stats;
+    
+    F32 throughputCutoff;
+    U32 russianRoulette;
+    U32 diffuseBounce;
 };
 
-struct RayTraceSectionRowData {
+//NOTE(ans): the primary hit of one sample, enough to start ShadeHit without tracing
+struct GBufferSample {
+    U32 hit;
+    U32 hitMatIndex;
+    U32 hitId;
+    V3 hitNormal;
+    V3 hitPoint;
+};
+
+//NOTE(ans): 
+// samplesPerPixel samples per pixel, the samples of a pixel are next to each other.
+// only valid for the camera, image size and sampling of the render that recorded it
+struct GBuffer {
+    GBufferSample* samples;
+    U64 sampleCapacity;
+    
+    SAAMode saaMode;
+    U32 samplesPerPixel;
+    U32 samplesPerDim;
+    bool recorded;
+};
+
+struct WavefrontQueues;
+
+struct RayTraceThreadData {
+    U32 threadIndex;
     U32 imageHeight;
-    U32 rowHeight; 
-    U32 rowWidth; 
-    U32 rowYStart;
+    U32 imageWidth;
     
     V3 cameraP; 
     V3 cameraX;
@@ -64,9 +237,60 @@ struct RayTraceSectionRowData {
     World* world;
     Options options; 
     SAAData saaData;
-    U32* packedPixelData;
+    //NOTE(ans): linear colors, the progressive render adds up its passes here
+    V3* hdrPixelData;
+    //NOTE(ans): first image row stored in hdrPixelData, only streamed renders hold less than the full image
+    U32 pixelRowOffset;
+    //NOTE(ans): GetCPUTicks spent per pixel, 0 when no cost image is written
+    F32* pixelCostData;
     
+    //NOTE(ans): reseeded for every sample with BeginSample
     RandomSeries series;
-    U32 randomCirclePointCount;
-    V3* randomCirclePoints;
+    SobolDiskPoint* sobolDiskPoints;
+    //NOTE(ans): one per light, 0 without shadow maps
+    ShadowMap* shadowMaps;
+    //NOTE(ans): shared by all threads, 0 without the cache
+    VisibilityCache* visibilityCache;
+    
+    RayTraceStats stats;
+    
+    U32 passIndex;
+    
+    WavefrontQueues* wavefront;
+    
+    //NOTE(ans): 0 when no primary hits are recorded, with reshade set the hits are read instead of traced
+    GBufferSample* gBufferSamples;
+    U32 reshade;
 };
+
+struct ThreadPool;
+
+//NOTE(ans): lives across renders, owns the threads and all per thread scratch memory
+struct RenderContext {
+    ThreadPool* threadPool;
+    U32 threadCount;
+    
+    TileScheduler scheduler;
+    RayTraceThreadData* threadData;
+    
+    V3** sampleDataBuffers;
+    U32 sampleDataCapacity;
+    
+    //NOTE(ans): shared by all threads, holds the first sampleDataCapacity points
+    SobolDiskPoint* sobolDiskPoints;
+    
+    ToneMap toneMap;
+    
+    WavefrontQueues* wavefrontQueues;
+    
+    GBuffer gBuffer;
+    
+    //NOTE(ans): shadowMapCapacity maps, the ones past the light count of the world are unused
+    ShadowMap* shadowMaps;
+    U32 shadowMapCapacity;
+    
+    VisibilityCache* visibilityCache;
+    
+    //NOTE(ans): stats of the last render, the per thread ones stay in threadData
+    RayTraceStats stats;
+};
\ No newline at end of file
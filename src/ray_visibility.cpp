@@ -0,0 +1,245 @@
+//NOTE(ans): the entries only grow, every render clears the ones it uses
+static void ClearVisibilityCache(RenderContext* context, World* world, V3 cameraP, Options* options) {
+    if(!context->visibilityCache) {
+        context->visibilityCache = (VisibilityCache*)malloc(sizeof(VisibilityCache));
+        *context->visibilityCache = {};
+    }
+    
+    VisibilityCache* cache = context->visibilityCache;
+    
+    //NOTE(ans): rounded down to a power of two, so the slot of a hash is a mask away
+    U32 entryCount = 1;
+    while(entryCount * 2 <= options->visibilityCacheSize && entryCount * 2 != 0) {
+        entryCount *= 2;
+    }
+    
+    if(entryCount > cache->entryCapacity) {
+        free(cache->entries);
+        cache->entries = (VisibilityCacheEntry*)malloc(sizeof(VisibilityCacheEntry) * entryCount);
+        cache->entryCapacity = entryCount;
+    }
+    
+    for(U32 entryIndex = 0; entryIndex < entryCount; ++entryIndex) {
+        cache->entries[entryIndex].key = 0;
+    }
+    
+    F32 maxSpacing = F32_MAX;
+    for(U32 sphereIndex = 0; sphereIndex < world->sphereCount; ++sphereIndex) {
+        maxSpacing = Min(maxSpacing, world->spheres[sphereIndex].r);
+    }
+    
+    cache->entryMask = entryCount - 1;
+    cache->spacing = Min(options->visibilityCacheSpacing, maxSpacing);
+    cache->maxSpacing = maxSpacing;
+    cache->cameraP = cameraP;
+    cache->samplesPerShading = options->samplesPerShading;
+    cache->sampleRadius = options->sampleRegionSize;
+    cache->sobolDiskPoints = context->sobolDiskPoints;
+    cache->randomSeed = options->randomSeed;
+    cache->frameIndex = options->frameIndex;
+}
+
+static void FreeVisibilityCache(RenderContext* context) {
+    if(context->visibilityCache) {
+        free(context->visibilityCache->entries);
+    }
+    free(context->visibilityCache);
+    
+    context->visibilityCache = 0;
+}
+
+//NOTE(ans):
+// all samples of the light from one lattice point, like RayTraceLights without pilot samples.
+// the scramble comes from the key, so every thread traces the same entry for the same point
+static VisibilityCacheEntry TraceVisibilityCacheEntry(VisibilityCache* cache, World* world,
+                                                      Light light, U32 ignoreId,
+                                                      V3 point, V3 normal, U64 key,
+                                                      V3* sampleBuffer, RayTraceStats* stats) {
+    U32 hash = HashU32(cache->randomSeed);
+    hash = HashU32(hash ^ (U32)key);
+    hash = HashU32(hash ^ (U32)(key >> 32));
+    hash = HashU32(hash ^ cache->frameIndex);
+    
+    RandomSeries series;
+    series.series = hash ? hash : 1;
+    
+    GenerateLightSamples(sampleBuffer, 0, cache->samplesPerShading,
+                         normal, point,
+                         cache->sobolDiskPoints,
+                         RandomLightSampleScramble(&series),
+                         cache->sampleRadius);
+    
+    U32 tracedCount = 0;
+    U32 visibleCount = 0;
+    F32 closestBlocker = F32_MAX;
+    for(U32 sampleIndex = 0; sampleIndex < cache->samplesPerShading; ++sampleIndex) {
+        V3 lightRayOrigin = sampleBuffer[sampleIndex];
+        
+        V3 lightRayDirection;
+        F32 traceMaxDistance;
+        V3 lightIntensity = CalculateLightSample(light, normal, lightRayOrigin,
+                                                 &lightRayDirection, &traceMaxDistance);
+        
+        if(lightIntensity.r == 0 && lightIntensity.g == 0 && lightIntensity.b == 0) {
+            continue;
+        }
+        
+        F32 blockerDistance;
+        if(RayTraceOcclusion(lightRayOrigin, lightRayDirection,
+                             world,
+                             traceMaxDistance,
+                             ignoreId,
+                             stats,
+                             &blockerDistance)) {
+            closestBlocker = Min(closestBlocker, blockerDistance);
+        } else {
+            ++visibleCount;
+        }
+        
+        ++tracedCount;
+    }
+    
+    stats->shadowRayCount += tracedCount;
+    ++stats->visibilityCacheEntryCount;
+    
+    VisibilityCacheEntry result;
+    result.key = key;
+    result.visibility = tracedCount ? (F32)visibleCount / (F32)tracedCount : 0;
+    result.blockerDistance = closestBlocker;
+    
+    return result;
+}
+
+//NOTE(ans):
+// finds the entry of key or traces it. slots only go from empty to busy to ready, so an entry is always
+// found before the first empty slot of its probe sequence. two threads can trace the same entry,
+// the one that claims a slot first stores it and both got the same value anyway
+static VisibilityCacheEntry GetVisibilityCacheEntry(VisibilityCache* cache, World* world,
+                                                    Light light, U32 ignoreId,
+                                                    V3 point, V3 normal, U64 key,
+                                                    V3* sampleBuffer, RayTraceStats* stats) {
+    U32 slot = HashU32((U32)key ^ HashU32((U32)(key >> 32)));
+    
+    VisibilityCacheEntry* freeEntry = 0;
+    for(U32 probe = 0; probe < VISIBILITY_CACHE_PROBES; ++probe) {
+        VisibilityCacheEntry* entry = cache->entries + ((slot + probe) & cache->entryMask);
+        U64 entryKey = entry->key;
+        
+        if(entryKey == (key | VISIBILITY_CACHE_READY)) {
+            return *entry;
+        }
+        
+        if(entryKey == 0) {
+            freeEntry = entry;
+            break;
+        }
+    }
+    
+    VisibilityCacheEntry result = TraceVisibilityCacheEntry(cache, world,
+                                                            light, ignoreId,
+                                                            point, normal, key,
+                                                            sampleBuffer, stats);
+    
+    if(freeEntry && AtomicCompareExchangeU64(&freeEntry->key, key | VISIBILITY_CACHE_BUSY, 0) == 0) {
+        freeEntry->visibility = result.visibility;
+        freeEntry->blockerDistance = result.blockerDistance;
+        
+        //NOTE(ans): the exchange is a full barrier, readers never see READY before the values
+        AtomicCompareExchangeU64(&freeEntry->key, key | VISIBILITY_CACHE_READY, key | VISIBILITY_CACHE_BUSY);
+    }
+    
+    return result;
+}
+
+//NOTE(ans):
+// visibility of light at a hit of the plane objectId, interpolated from the four lattice points
+// around it. false for hits of spheres, hits outside the lattice and hits closer to a blocker seen
+// from a lattice point than to the lattice point, those trace their own shadow rays
+static bool LookupVisibilityCache(VisibilityCache* cache, World* world,
+                                  U32 lightIndex, U32 objectId, V3 hitPoint,
+                                  V3* sampleBuffer, RayTraceStats* stats,
+                                  F32* visibility) {
+    U32 planeIndex = 0;
+    while(planeIndex < world->planeCount && world->planes[planeIndex].id != objectId) {
+        ++planeIndex;
+    }
+    
+    //NOTE(ans): 5 bits of light, 4 of level, 13 of plane and 2 x 20 of lattice coordinates make up the key
+    if(planeIndex == world->planeCount || planeIndex >= (1 << 13) || lightIndex >= (1 << 5)) {
+        return false;
+    }
+    
+    Plane plane = world->planes[planeIndex];
+    Light light = world->lights[lightIndex];
+    
+    F32 cameraDistance = LengthRoot(hitPoint - cache->cameraP);
+    
+    U32 level = 0;
+    F32 spacing = cache->spacing;
+    while(level + 1 < VISIBILITY_CACHE_LEVELS &&
+          spacing < cameraDistance * VISIBILITY_CACHE_SPACING_PER_DISTANCE &&
+          spacing * 2 <= cache->maxSpacing) {
+        spacing *= 2;
+        ++level;
+    }
+    
+    V3 up = {0, 0, 1};
+    if(plane.n.z > 0.9f || plane.n.z < -0.9f) {
+        up = {1, 0, 0};
+    }
+    
+    V3 axisU = Normalize(Cross(plane.n, up));
+    V3 axisV = Cross(plane.n, axisU);
+    
+    V3 relative = hitPoint - plane.p;
+    F32 u = Inner(relative, axisU) / spacing;
+    F32 v = Inner(relative, axisV) / spacing;
+    
+    F32 cellU = floorf(u);
+    F32 cellV = floorf(v);
+    
+    F32 coordinateBias = (F32)(1 << 19);
+    if(cellU < -coordinateBias || cellV < -coordinateBias ||
+       cellU + 1 >= coordinateBias || cellV + 1 >= coordinateBias) {
+        return false;
+    }
+    
+    F32 fractionU = u - cellU;
+    F32 fractionV = v - cellV;
+    
+    U64 cellKey = ((U64)lightIndex << 57) | ((U64)level << 53) | ((U64)planeIndex << 40);
+    
+    F32 result = 0;
+    for(U32 corner = 0; corner < 4; ++corner) {
+        U32 offsetU = corner & 1;
+        U32 offsetV = corner >> 1;
+        
+        F32 cornerU = cellU + (F32)offsetU;
+        F32 cornerV = cellV + (F32)offsetV;
+        
+        F32 weight = (offsetU ? fractionU : 1 - fractionU) * (offsetV ? fractionV : 1 - fractionV);
+        
+        U64 key = cellKey |
+            ((U64)(U32)(cornerU + coordinateBias) << 20) |
+            (U64)(U32)(cornerV + coordinateBias);
+        
+        V3 cornerPoint = plane.p + axisU * (cornerU * spacing) + axisV * (cornerV * spacing);
+        
+        VisibilityCacheEntry entry = GetVisibilityCacheEntry(cache, world,
+                                                             light, plane.id,
+                                                             cornerPoint, plane.n, key,
+                                                             sampleBuffer, stats);
+        
+        //NOTE(ans): Length is squared, so is the blocker distance
+        if(entry.blockerDistance != F32_MAX &&
+           Length(cornerPoint - hitPoint) > entry.blockerDistance * entry.blockerDistance) {
+            return false;
+        }
+        
+        result += entry.visibility * weight;
+    }
+    
+    *visibility = result;
+    
+    return true;
+}
@@ -0,0 +1,60 @@
+/*
+Visibility Cache
+
+the soft shadows on a plane change slowly over its surface, so every light keeps the fraction of
+its samples that reach a plane at the points of a lattice on that plane. a plane hit interpolates
+the four lattice points around it and only traces its own shadow rays when one of them saw a
+blocker closer than the hit is to the lattice point, there the shadow can change faster than the
+lattice. every entry only depends on its lattice point, so the image does not depend on which
+thread traced an entry first.
+the spacing doubles with the distance to the camera, so far away the lattice stays coarser than the pixels.
+it never gets larger than the radius of the smallest sphere, a shadow that fits between four lattice
+points would not block any of them and get interpolated away.
+*/
+
+//NOTE(ans): the key of an entry stays 0 until a thread claims it, readers only use it once READY is set
+#define VISIBILITY_CACHE_BUSY  ((U64)1 << 62)
+#define VISIBILITY_CACHE_READY ((U64)1 << 63)
+
+//NOTE(ans): slots looked at per lattice point, a full neighbourhood traces without storing
+#define VISIBILITY_CACHE_PROBES 16
+
+//NOTE(ans): lattice levels, the spacing doubles every level
+#define VISIBILITY_CACHE_LEVELS 16
+
+//NOTE(ans): the spacing of a level has to stay above distance to the camera * this, about ten pixels at 640x360
+#define VISIBILITY_CACHE_SPACING_PER_DISTANCE (1.0f / 64.0f)
+
+struct VisibilityCacheEntry {
+    volatile U64 key;
+    F32 visibility;
+    //NOTE(ans): closest blocker of the samples, F32_MAX when all of them reached the light
+    F32 blockerDistance;
+};
+
+struct VisibilityCache {
+    //NOTE(ans): entryMask + 1 entries, a power of two
+    VisibilityCacheEntry* entries;
+    U32 entryMask;
+    U32 entryCapacity;
+    
+    F32 spacing;
+    //NOTE(ans): radius of the smallest sphere, F32_MAX without spheres
+    F32 maxSpacing;
+    V3 cameraP;
+    
+    //NOTE(ans): the entries take the same light samples as RayTraceLights
+    U32 samplesPerShading;
+    F32 sampleRadius;
+    SobolDiskPoint* sobolDiskPoints;
+    U32 randomSeed;
+    U32 frameIndex;
+};
+
+//NOTE(ans): defined in ray_visibility.cpp, which comes after ray_tracing.cpp
+static void ClearVisibilityCache(RenderContext* context, World* world, V3 cameraP, Options* options);
+static void FreeVisibilityCache(RenderContext* context);
+static bool LookupVisibilityCache(VisibilityCache* cache, World* world,
+                                  U32 lightIndex, U32 objectId, V3 hitPoint,
+                                  V3* sampleBuffer, RayTraceStats* stats,
+                                  F32* visibility);
@@ -0,0 +1,811 @@
+//NOTE(ans): queues only grow, so rendering the same options again allocates nothing
+static void ReserveWavefrontQueues(WavefrontQueues* queues, U32 sampleCapacity, U32 lightCount) {
+    if(sampleCapacity > queues->sampleCapacity) {
+        free(queues->rays);
+        free(queues->nextRays);
+        free(queues->hits);
+        free(queues->sampleColors);
+        
+        queues->rays = (WavefrontRay*)malloc(sizeof(WavefrontRay) * sampleCapacity);
+        queues->nextRays = (WavefrontRay*)malloc(sizeof(WavefrontRay) * sampleCapacity);
+        queues->hits = (ShootRayResult*)malloc(sizeof(ShootRayResult) * sampleCapacity);
+        queues->sampleColors = (V3*)malloc(sizeof(V3) * sampleCapacity);
+        queues->sampleCapacity = sampleCapacity;
+    }
+    
+    //NOTE(ans): every ray of a bounce can create one task per light
+    U32 lightTaskCapacity = sampleCapacity * lightCount;
+    if(lightTaskCapacity > queues->lightTaskCapacity) {
+        free(queues->lightTasks);
+        
+        queues->lightTasks = (LightTask*)malloc(sizeof(LightTask) * lightTaskCapacity);
+        queues->lightTaskCapacity = lightTaskCapacity;
+    }
+    
+    if(!queues->shadowRays) {
+        queues->shadowRays = (ShadowRay*)malloc(sizeof(ShadowRay) * WAVEFRONT_SHADOW_QUEUE_SIZE);
+        queues->shadowRayCount = 0;
+    }
+    
+    U32 sortCapacity = sampleCapacity;
+    if(sortCapacity < WAVEFRONT_SHADOW_QUEUE_SIZE) {
+        sortCapacity = WAVEFRONT_SHADOW_QUEUE_SIZE;
+    }
+    
+    if(sortCapacity > queues->sortCapacity) {
+        free(queues->sortItems);
+        free(queues->sortTemp);
+        
+        queues->sortItems = (U64*)malloc(sizeof(U64) * sortCapacity);
+        queues->sortTemp = (U64*)malloc(sizeof(U64) * sortCapacity);
+        queues->sortCapacity = sortCapacity;
+    }
+}
+
+static void FreeWavefrontQueues(WavefrontQueues* queues) {
+    free(queues->rays);
+    free(queues->nextRays);
+    free(queues->hits);
+    free(queues->sampleColors);
+    free(queues->lightTasks);
+    free(queues->shadowRays);
+    free(queues->sortItems);
+    free(queues->sortTemp);
+    
+    *queues = {};
+}
+
+static inline U32 SpreadBits3(U32 v) {
+    //NOTE(ans): inserts two zero bits between each of the lower 10 bits
+    v &= 0x000003FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    
+    return v;
+}
+
+//NOTE(ans):
+// octant in the top bits so rays of one octant stay together, below that the morton code
+// of the direction so rays that point the same way end up in the same group of 8
+static inline U32 DirectionSortKey(V3 direction) {
+    U32 octant = ((direction.x < 0) << 2) | ((direction.y < 0) << 1) | (direction.z < 0);
+    
+    U32 x = (U32)((direction.x * 0.5f + 0.5f) * 511.0f);
+    U32 y = (U32)((direction.y * 0.5f + 0.5f) * 511.0f);
+    U32 z = (U32)((direction.z * 0.5f + 0.5f) * 511.0f);
+    
+    U32 result = (octant << 27) | SpreadBits3(x) | (SpreadBits3(y) << 1) | (SpreadBits3(z) << 2);
+    
+    return result;
+}
+
+//NOTE(ans): radix sort on the key half of the items, stable so equal keys keep their queue order
+static void SortQueue(U64* items, U64* temp, U32 count) {
+    for(U32 shift = 32; shift < 64; shift += 8) {
+        U32 offsets[256] = {};
+        
+        for(U32 itemIndex = 0; itemIndex < count; ++itemIndex) {
+            ++offsets[(items[itemIndex] >> shift) & 0xFF];
+        }
+        
+        U32 total = 0;
+        for(U32 bucket = 0; bucket < 256; ++bucket) {
+            U32 bucketCount = offsets[bucket];
+            offsets[bucket] = total;
+            total += bucketCount;
+        }
+        
+        for(U32 itemIndex = 0; itemIndex < count; ++itemIndex) {
+            U64 item = items[itemIndex];
+            temp[offsets[(item >> shift) & 0xFF]++] = item;
+        }
+        
+        U64* swap = items;
+        items = temp;
+        temp = swap;
+    }
+    
+    //NOTE(ans): 4 passes, so the sorted result ends up in the original array again
+}
+
+//NOTE(ans): 8 rays with their own origins, lanes that are not in use repeat the first ray
+struct RayLanes {
+    F32x8 originX;
+    F32x8 originY;
+    F32x8 originZ;
+    F32x8 directionX;
+    F32x8 directionY;
+    F32x8 directionZ;
+    F32x8 inverseX;
+    F32x8 inverseY;
+    F32x8 inverseZ;
+    
+    U32 activeBits;
+    U32 activeCount;
+};
+
+static inline void LoadRayLanes(RayLanes* lanes, V3* origins, V3* directions, U32 count) {
+    F32 values[9][LANE_WIDTH];
+    
+    for(U32 lane = 0; lane < LANE_WIDTH; ++lane) {
+        U32 source = lane < count ? lane : 0;
+        V3 origin = origins[source];
+        V3 direction = directions[source];
+        V3 inverseDirection = InverseDirection(direction);
+        
+        values[0][lane] = origin.x;
+        values[1][lane] = origin.y;
+        values[2][lane] = origin.z;
+        values[3][lane] = direction.x;
+        values[4][lane] = direction.y;
+        values[5][lane] = direction.z;
+        values[6][lane] = inverseDirection.x;
+        values[7][lane] = inverseDirection.y;
+        values[8][lane] = inverseDirection.z;
+    }
+    
+    lanes->originX = LoadF32x8(values[0]);
+    lanes->originY = LoadF32x8(values[1]);
+    lanes->originZ = LoadF32x8(values[2]);
+    lanes->directionX = LoadF32x8(values[3]);
+    lanes->directionY = LoadF32x8(values[4]);
+    lanes->directionZ = LoadF32x8(values[5]);
+    lanes->inverseX = LoadF32x8(values[6]);
+    lanes->inverseY = LoadF32x8(values[7]);
+    lanes->inverseZ = LoadF32x8(values[8]);
+    
+    lanes->activeBits = (1 << count) - 1;
+    lanes->activeCount = count;
+}
+
+//NOTE(ans): slab test for all lanes, returns the lanes that hit and their entry distance
+static inline U32 IntersectAABBLanes(AABB bounds, RayLanes* lanes, F32x8 maxDistance, F32x8* tEnter) {
+    F32x8 t1x = (SetF32x8(bounds.min.x) - lanes->originX) * lanes->inverseX;
+    F32x8 t2x = (SetF32x8(bounds.max.x) - lanes->originX) * lanes->inverseX;
+    F32x8 t1y = (SetF32x8(bounds.min.y) - lanes->originY) * lanes->inverseY;
+    F32x8 t2y = (SetF32x8(bounds.max.y) - lanes->originY) * lanes->inverseY;
+    F32x8 t1z = (SetF32x8(bounds.min.z) - lanes->originZ) * lanes->inverseZ;
+    F32x8 t2z = (SetF32x8(bounds.max.z) - lanes->originZ) * lanes->inverseZ;
+    
+    *tEnter = Max(Max(Min(t1x, t2x), Min(t1y, t2y)), Min(t1z, t2z));
+    F32x8 tExit = Min(Min(Max(t1x, t2x), Max(t1y, t2y)), Max(t1z, t2z));
+    
+    F32x8 hitMask = (tExit >= *tEnter) & (tExit > SetF32x8(0)) & (*tEnter < maxDistance);
+    
+    U32 result = MaskBits(hitMask) & lanes->activeBits;
+    
+    return result;
+}
+
+static inline F32x8 IntersectPlaneLanes(Plane plane, RayLanes* lanes, F32x8* hitMask, F32x8 maxDistance) {
+    F32 tolerance = 0.01;
+    
+    F32x8 nx = SetF32x8(plane.n.x);
+    F32x8 ny = SetF32x8(plane.n.y);
+    F32x8 nz = SetF32x8(plane.n.z);
+    
+    F32x8 divisor = lanes->directionX * nx + lanes->directionY * ny + lanes->directionZ * nz;
+    F32x8 divident = SetF32x8(Inner(plane.p, plane.n)) -
+        (lanes->originX * nx + lanes->originY * ny + lanes->originZ * nz);
+    F32x8 t = divident / divisor;
+    
+    *hitMask = ((divisor < SetF32x8(-tolerance)) | (divisor > SetF32x8(tolerance))) &
+        (t > SetF32x8(tolerance)) & (t < maxDistance);
+    
+    return t;
+}
+
+static inline F32x8 IntersectSphereLanes(Sphere sphere, RayLanes* lanes, F32x8* hitMask, F32x8 maxDistance) {
+    F32 tolerance = 0.01;
+    F32x8 toleranceLanes = SetF32x8(tolerance);
+    F32x8 zero = SetF32x8(0);
+    F32x8 two = SetF32x8(2);
+    
+    F32x8 relativeX = lanes->originX - SetF32x8(sphere.p.x);
+    F32x8 relativeY = lanes->originY - SetF32x8(sphere.p.y);
+    F32x8 relativeZ = lanes->originZ - SetF32x8(sphere.p.z);
+    
+    F32x8 a = lanes->directionX * lanes->directionX +
+        lanes->directionY * lanes->directionY +
+        lanes->directionZ * lanes->directionZ;
+    F32x8 b = two * (lanes->directionX * relativeX + lanes->directionY * relativeY + lanes->directionZ * relativeZ);
+    F32x8 c = (relativeX * relativeX + relativeY * relativeY + relativeZ * relativeZ) -
+        SetF32x8(sphere.r * sphere.r);
+    F32x8 rootTerm = b * b - SetF32x8(4) * a * c;
+    F32x8 rootValue = SquareRoot(Max(rootTerm, zero));
+    
+    F32x8 negativeB = zero - b;
+    F32x8 tPlus = ((negativeB + rootValue) / two) * a;
+    F32x8 tMinus = ((negativeB - rootValue) / two) * a;
+    F32x8 distance = Min(tPlus, tMinus);
+    
+    *hitMask = (rootTerm > toleranceLanes) & (distance > toleranceLanes) & (distance < maxDistance);
+    
+    return distance;
+}
+
+//NOTE(ans): closest hit for up to 8 rays, same results as RayTraceObjects for every lane
+static void RayTraceObjectsLanes(RayLanes* lanes, World* world,
+                                 F32 hitDistances[LANE_WIDTH],
+                                 U32 hitPlaneIndices[LANE_WIDTH],
+                                 U32 hitSphereIndices[LANE_WIDTH],
+                                 RayTraceStats* stats) {
+    F32x8 hitDistance = SetF32x8(F32_MAX);
+    
+    for(U32 lane = 0; lane < LANE_WIDTH; ++lane) {
+        hitPlaneIndices[lane] = U32_MAX;
+        hitSphereIndices[lane] = U32_MAX;
+    }
+    
+    Plane* planes = world->planes;
+    U32 planeCount = world->planeCount;
+    
+    U32 boxTestCount = 0;
+    U32 primitiveTestCount = planeCount;
+    for(U32 planeIndex = 0; planeIndex < planeCount; ++planeIndex) {
+        F32x8 hitMask;
+        F32x8 t = IntersectPlaneLanes(planes[planeIndex], lanes, &hitMask, hitDistance);
+        
+        U32 hitBits = MaskBits(hitMask) & lanes->activeBits;
+        if(hitBits) {
+            hitDistance = Select(hitDistance, t, hitMask);
+            
+            while(hitBits) {
+                U32 lane = FirstBit(hitBits);
+                hitBits &= hitBits - 1;
+                
+                hitPlaneIndices[lane] = planeIndex;
+            }
+        }
+    }
+    
+    Sphere* spheres = world->spheres;
+    BVHNode* nodes = world->sphereNodes;
+    
+    if(world->sphereNodeCount) {
+        U32 nodeStack[BVH_MAX_DEPTH];
+        U32 nodeStackCount = 0;
+        nodeStack[nodeStackCount++] = 0;
+        
+        while(nodeStackCount) {
+            BVHNode* node = nodes + nodeStack[--nodeStackCount];
+            
+            F32x8 tEnter;
+            ++boxTestCount;
+            if(!IntersectAABBLanes(node->bounds, lanes, hitDistance, &tEnter)) {
+                continue;
+            }
+            
+            if(node->count == 0) {
+                //NOTE(ans): the child the lanes enter first gets visited first
+                U32 leftIndex = node->firstIndex;
+                U32 rightIndex = leftIndex + 1;
+                
+                F32x8 leftEnter, rightEnter;
+                U32 leftBits = IntersectAABBLanes(nodes[leftIndex].bounds, lanes, hitDistance, &leftEnter);
+                U32 rightBits = IntersectAABBLanes(nodes[rightIndex].bounds, lanes, hitDistance, &rightEnter);
+                boxTestCount += 2;
+                
+                F32 leftDistance = F32_MAX;
+                F32 rightDistance = F32_MAX;
+                if(leftBits) {
+                    MinLane(leftEnter, &leftDistance);
+                }
+                if(rightBits) {
+                    MinLane(rightEnter, &rightDistance);
+                }
+                
+                if(leftDistance < rightDistance) {
+                    if(rightBits) {
+                        nodeStack[nodeStackCount++] = rightIndex;
+                    }
+                    nodeStack[nodeStackCount++] = leftIndex;
+                } else {
+                    if(leftBits) {
+                        nodeStack[nodeStackCount++] = leftIndex;
+                    }
+                    if(rightBits) {
+                        nodeStack[nodeStackCount++] = rightIndex;
+                    }
+                }
+                
+                continue;
+            }
+            
+            U32 sphereEnd = node->firstIndex + node->count;
+            primitiveTestCount += node->count;
+            for(U32 sphereIndex = node->firstIndex;
+                sphereIndex < sphereEnd;
+                ++sphereIndex) {
+                F32x8 hitMask;
+                F32x8 distance = IntersectSphereLanes(spheres[sphereIndex], lanes, &hitMask, hitDistance);
+                
+                U32 hitBits = MaskBits(hitMask) & lanes->activeBits;
+                if(hitBits) {
+                    hitDistance = Select(hitDistance, distance, hitMask);
+                    
+                    while(hitBits) {
+                        U32 lane = FirstBit(hitBits);
+                        hitBits &= hitBits - 1;
+                        
+                        hitSphereIndices[lane] = sphereIndex;
+                    }
+                }
+            }
+        }
+    }
+    
+    StoreF32x8(hitDistances, hitDistance);
+    
+    stats->boxTestCount += boxTestCount * lanes->activeCount;
+    stats->primitiveTestCount += primitiveTestCount * lanes->activeCount;
+}
+
+//NOTE(ans): any hit for up to 8 shadow rays, returns the lanes that are blocked
+static U32 RayTraceOcclusionLanes(RayLanes* lanes, World* world,
+                                  F32 maxDistances[LANE_WIDTH],
+                                  U32 ignoreIds[LANE_WIDTH],
+                                  RayTraceStats* stats) {
+    F32x8 maxDistance = LoadF32x8(maxDistances);
+    U32 blockedBits = 0;
+    
+    Plane* planes = world->planes;
+    U32 planeCount = world->planeCount;
+    
+    U32 boxTestCount = 0;
+    U32 primitiveTestCount = planeCount;
+    for(U32 planeIndex = 0; planeIndex < planeCount; ++planeIndex) {
+        Plane plane = planes[planeIndex];
+        
+        F32x8 hitMask;
+        IntersectPlaneLanes(plane, lanes, &hitMask, maxDistance);
+        
+        U32 hitBits = MaskBits(hitMask) & lanes->activeBits & ~blockedBits;
+        while(hitBits) {
+            U32 lane = FirstBit(hitBits);
+            hitBits &= hitBits - 1;
+            
+            if(plane.id != ignoreIds[lane]) {
+                blockedBits |= 1 << lane;
+            }
+        }
+    }
+    
+    Sphere* spheres = world->spheres;
+    BVHNode* nodes = world->sphereNodes;
+    
+    if(world->sphereNodeCount && blockedBits != lanes->activeBits) {
+        U32 nodeStack[BVH_MAX_DEPTH];
+        U32 nodeStackCount = 0;
+        nodeStack[nodeStackCount++] = 0;
+        
+        while(nodeStackCount) {
+            BVHNode* node = nodes + nodeStack[--nodeStackCount];
+            
+            F32x8 tEnter;
+            ++boxTestCount;
+            U32 nodeBits = IntersectAABBLanes(node->bounds, lanes, maxDistance, &tEnter) & ~blockedBits;
+            if(!nodeBits) {
+                continue;
+            }
+            
+            if(node->count == 0) {
+                nodeStack[nodeStackCount++] = node->firstIndex + 1;
+                nodeStack[nodeStackCount++] = node->firstIndex;
+                
+                continue;
+            }
+            
+            U32 sphereEnd = node->firstIndex + node->count;
+            primitiveTestCount += node->count;
+            for(U32 sphereIndex = node->firstIndex;
+                sphereIndex < sphereEnd;
+                ++sphereIndex) {
+                Sphere sphere = spheres[sphereIndex];
+                
+                F32x8 hitMask;
+                IntersectSphereLanes(sphere, lanes, &hitMask, maxDistance);
+                
+                U32 hitBits = MaskBits(hitMask) & nodeBits & ~blockedBits;
+                while(hitBits) {
+                    U32 lane = FirstBit(hitBits);
+                    hitBits &= hitBits - 1;
+                    
+                    if(sphere.id != ignoreIds[lane]) {
+                        blockedBits |= 1 << lane;
+                    }
+                }
+            }
+            
+            if(blockedBits == lanes->activeBits) {
+                break;
+            }
+        }
+    }
+    
+    stats->boxTestCount += boxTestCount * lanes->activeCount;
+    stats->primitiveTestCount += primitiveTestCount * lanes->activeCount;
+    
+    return blockedBits;
+}
+
+//NOTE(ans): closest hit stage, sorts the queue and fills queues->hits in queue order
+static void TraceWavefrontRays(World* world, WavefrontQueues* queues, U32 rayCount, RayTraceStats* stats) {
+    WavefrontRay* rays = queues->rays;
+    U64* items = queues->sortItems;
+    
+    for(U32 rayIndex = 0; rayIndex < rayCount; ++rayIndex) {
+        items[rayIndex] = ((U64)DirectionSortKey(rays[rayIndex].direction) << 32) | rayIndex;
+    }
+    SortQueue(items, queues->sortTemp, rayCount);
+    
+    for(U32 groupStart = 0; groupStart < rayCount; groupStart += LANE_WIDTH) {
+        U32 groupCount = rayCount - groupStart;
+        if(groupCount > LANE_WIDTH) {
+            groupCount = LANE_WIDTH;
+        }
+        
+        V3 origins[LANE_WIDTH];
+        V3 directions[LANE_WIDTH];
+        U32 rayIndices[LANE_WIDTH];
+        for(U32 lane = 0; lane < groupCount; ++lane) {
+            U32 rayIndex = (U32)items[groupStart + lane];
+            
+            rayIndices[lane] = rayIndex;
+            origins[lane] = rays[rayIndex].origin;
+            directions[lane] = rays[rayIndex].direction;
+        }
+        
+        RayLanes lanes;
+        LoadRayLanes(&lanes, origins, directions, groupCount);
+        
+        F32 hitDistances[LANE_WIDTH];
+        U32 hitPlaneIndices[LANE_WIDTH];
+        U32 hitSphereIndices[LANE_WIDTH];
+        RayTraceObjectsLanes(&lanes, world, hitDistances, hitPlaneIndices, hitSphereIndices, stats);
+        
+        for(U32 lane = 0; lane < groupCount; ++lane) {
+            ShootRayResult result = {};
+            ResolveHit(origins[lane], directions[lane],
+                       world,
+                       hitDistances[lane], hitPlaneIndices[lane], hitSphereIndices[lane],
+                       &result);
+            
+            queues->hits[rayIndices[lane]] = result;
+        }
+    }
+}
+
+//NOTE(ans): any hit stage, every visible shadow ray adds its contribution to its sample
+static void FlushShadowRays(RayTraceThreadData* data) {
+    WavefrontQueues* queues = data->wavefront;
+    ShadowRay* shadowRays = queues->shadowRays;
+    U32 shadowRayCount = queues->shadowRayCount;
+    U64* items = queues->sortItems;
+    
+    for(U32 rayIndex = 0; rayIndex < shadowRayCount; ++rayIndex) {
+        items[rayIndex] = ((U64)DirectionSortKey(shadowRays[rayIndex].direction) << 32) | rayIndex;
+    }
+    SortQueue(items, queues->sortTemp, shadowRayCount);
+    
+    for(U32 groupStart = 0; groupStart < shadowRayCount; groupStart += LANE_WIDTH) {
+        U32 groupCount = shadowRayCount - groupStart;
+        if(groupCount > LANE_WIDTH) {
+            groupCount = LANE_WIDTH;
+        }
+        
+        V3 origins[LANE_WIDTH];
+        V3 directions[LANE_WIDTH];
+        F32 maxDistances[LANE_WIDTH];
+        U32 ignoreIds[LANE_WIDTH];
+        for(U32 lane = 0; lane < LANE_WIDTH; ++lane) {
+            ShadowRay* shadowRay = shadowRays + (U32)items[groupStart + (lane < groupCount ? lane : 0)];
+            
+            origins[lane] = shadowRay->origin;
+            directions[lane] = shadowRay->direction;
+            maxDistances[lane] = shadowRay->maxDistance;
+            ignoreIds[lane] = shadowRay->ignoreId;
+        }
+        
+        RayLanes lanes;
+        LoadRayLanes(&lanes, origins, directions, groupCount);
+        
+        U32 blockedBits = RayTraceOcclusionLanes(&lanes, data->world, maxDistances, ignoreIds, &data->stats);
+        
+        for(U32 lane = 0; lane < groupCount; ++lane) {
+            ShadowRay* shadowRay = shadowRays + (U32)items[groupStart + lane];
+            LightTask* task = queues->lightTasks + shadowRay->taskIndex;
+            
+            ++task->tracedCount;
+            if(!(blockedBits & (1 << lane))) {
+                ++task->visibleCount;
+                queues->sampleColors[task->sampleIndex] = queues->sampleColors[task->sampleIndex] + shadowRay->contribution;
+            }
+        }
+    }
+    
+    data->stats.shadowRayCount += shadowRayCount;
+    queues->shadowRayCount = 0;
+}
+
+//NOTE(ans):
+// generates sampleCount light samples for the task, with traceRays unset the samples are
+// known to be visible and add their light right away
+static void EmitLightTaskSamples(RayTraceThreadData* data, U32 taskIndex,
+                                 U32 firstSample, U32 sampleCount, bool traceRays) {
+    WavefrontQueues* queues = data->wavefront;
+    LightTask* task = queues->lightTasks + taskIndex;
+    Light light = data->world->lights[task->lightIndex];
+    V3* lightSampleDataBuffer = data->options.sampleDataBuffer;
+    
+    ShadowMap* shadowMap = 0;
+    if(data->shadowMaps && data->shadowMaps[task->lightIndex].size) {
+        shadowMap = data->shadowMaps + task->lightIndex;
+    }
+    
+    GenerateLightSamples(lightSampleDataBuffer, firstSample, sampleCount,
+                         task->hitNormal, task->hitPoint,
+                         data->sobolDiskPoints,
+                         task->scramble,
+                         data->options.sampleRegionSize);
+    
+    F32 lightSampleContribution = 1.0f / task->sampleCount;
+    for(U32 lightSamplePointIndex = 0; lightSamplePointIndex < sampleCount; ++lightSamplePointIndex) {
+        V3 lightRayOrigin = lightSampleDataBuffer[lightSamplePointIndex];
+        
+        V3 lightRayDirection;
+        F32 traceMaxDistance;
+        V3 lightIntensity = CalculateLightSample(light, task->hitNormal, lightRayOrigin,
+                                                 &lightRayDirection, &traceMaxDistance);
+        
+        if(lightIntensity.r == 0 && lightIntensity.g == 0 && lightIntensity.b == 0) {
+            continue;
+        }
+        
+        V3 contribution = task->weightedColor * lightIntensity * lightSampleContribution;
+        
+        if(!traceRays) {
+            queues->sampleColors[task->sampleIndex] = queues->sampleColors[task->sampleIndex] + contribution;
+            continue;
+        }
+        
+        //NOTE(ans): samples the shadow map can answer never enter the queue
+        if(shadowMap) {
+            ShadowMapResult mapResult = LookupShadowMap(shadowMap, data->world, lightRayOrigin, task->objectId);
+            
+            if(mapResult != ShadowMapResult_Unknown) {
+                ++task->tracedCount;
+                ++data->stats.shadowMapSampleCount;
+                
+                if(mapResult == ShadowMapResult_Lit) {
+                    ++task->visibleCount;
+                    queues->sampleColors[task->sampleIndex] = queues->sampleColors[task->sampleIndex] + contribution;
+                }
+                
+                continue;
+            }
+        }
+        
+        if(queues->shadowRayCount == WAVEFRONT_SHADOW_QUEUE_SIZE) {
+            FlushShadowRays(data);
+        }
+        
+        ShadowRay* shadowRay = queues->shadowRays + queues->shadowRayCount++;
+        shadowRay->origin = lightRayOrigin;
+        shadowRay->direction = lightRayDirection;
+        shadowRay->maxDistance = traceMaxDistance;
+        shadowRay->ignoreId = task->objectId;
+        shadowRay->taskIndex = taskIndex;
+        shadowRay->contribution = contribution;
+    }
+}
+
+//NOTE(ans): shadow stage, same pilot logic as RayTraceLights but every phase runs over all tasks at once
+static void ProcessLightTasks(RayTraceThreadData* data, U32 taskCount) {
+    WavefrontQueues* queues = data->wavefront;
+    
+    U32 pilotCount = data->options.samplesPerShadingPilot;
+    
+    //NOTE(ans): the tasks have their own sample budgets, the ones with no more samples than pilots trace them all at once
+    for(U32 taskIndex = 0; taskIndex < taskCount; ++taskIndex) {
+        LightTask* task = queues->lightTasks + taskIndex;
+        bool adaptive = pilotCount > 0 && pilotCount < task->sampleCount;
+        
+        U32 firstCount = adaptive ? pilotCount : task->sampleCount;
+        EmitLightTaskSamples(data, taskIndex, 0, firstCount, true);
+    }
+    FlushShadowRays(data);
+    
+    data->stats.lightShadingCount += taskCount;
+    
+    if(!pilotCount) {
+        return;
+    }
+    
+    for(U32 taskIndex = 0; taskIndex < taskCount; ++taskIndex) {
+        LightTask* task = queues->lightTasks + taskIndex;
+        if(pilotCount >= task->sampleCount) {
+            continue;
+        }
+        
+        bool pilotAgreed = PilotSamplesAgree(task->tracedCount, task->visibleCount);
+        
+        if(pilotAgreed && !task->visibleCount) {
+            continue;
+        }
+        
+        if(!pilotAgreed) {
+            ++data->stats.penumbraCount;
+        }
+        
+        EmitLightTaskSamples(data, taskIndex, pilotCount, task->sampleCount - pilotCount, !pilotAgreed);
+    }
+    FlushShadowRays(data);
+}
+
+//NOTE(ans):
+// same image as RayTraceTile, but all samples of the tile go through every stage together:
+// closest hit for the whole ray queue, shading creates light tasks and the next ray queue,
+// the light tasks fill the shadow queue which gets traced in batches
+static void RayTraceTileWavefront(RayTraceThreadData* dataPointer, RenderTile tile) {
+    RayTraceThreadData& data = *dataPointer;
+    Options options = data.options;
+    SAAData saaData = data.saaData;
+    WavefrontQueues* queues = data.wavefront;
+    World* world = data.world;
+    Material* materials = world->materials;
+    
+    ShadingData shading = GetShadingData(&data);
+    
+    U32 samplesPerPixel = 1;
+    if(options.saaMode == SAAMode_SSAA) {
+        samplesPerPixel = options.samplesToTake;
+    }
+    
+    U32 rayCount = 0;
+    for(U32 tileY = 0; tileY < tile.height; ++tileY) {
+        U32 rowY = tile.y + tileY;
+        F32 viewPortY = - 1 + 2 * ((F32)rowY / (F32)data.imageHeight);
+        
+        for(U32 tileX = 0; tileX < tile.width; ++tileX) {
+            U32 rowX = tile.x + tileX;
+            F32 viewPortX = - 1 + 2 * ((F32)rowX / (F32)data.imageWidth);
+            
+            V3 filmXOffset = data.cameraX * (viewPortX * data.filmWidthHalf);
+            V3 filmYOffset = data.cameraY * (viewPortY * data.filmHeightHalf);
+            
+            V3 filmP = data.filmC + filmXOffset + filmYOffset;
+            
+            for(U32 sampleIndex = 0; sampleIndex < samplesPerPixel; ++sampleIndex) {
+                V3 samplePoint = filmP;
+                if(options.saaMode == SAAMode_SSAA) {
+                    samplePoint = CalculatePixelSamplingPoint(filmP,
+                                                              saaData.sampleRegionX, saaData.sampleRegionY,
+                                                              options.samplesPerDim, sampleIndex);
+                }
+                
+                WavefrontRay* ray = queues->rays + rayCount;
+                ray->origin = data.cameraP;
+                ray->direction = Normalize(samplePoint - data.cameraP);
+                ray->throughput = 1.0f;
+                ray->sampleIndex = rayCount;
+                ray->depth = 0;
+                ray->lastHitId = U32_MAX;
+                ray->series = SampleRandomSeries(rowX, rowY, sampleIndex,
+                                                 options.frameIndex, options.randomSeed);
+                
+                queues->sampleColors[rayCount] = {};
+                ++rayCount;
+            }
+        }
+    }
+    data.stats.primaryRayCount += rayCount;
+    
+    while(rayCount) {
+        TraceWavefrontRays(world, queues, rayCount, &data.stats);
+        
+        U32 nextRayCount = 0;
+        U32 taskCount = 0;
+        for(U32 rayIndex = 0; rayIndex < rayCount; ++rayIndex) {
+            WavefrontRay ray = queues->rays[rayIndex];
+            ShootRayResult result = queues->hits[rayIndex];
+            V3* sampleColor = queues->sampleColors + ray.sampleIndex;
+            
+            if(!result.hit) {
+                *sampleColor = *sampleColor + materials[result.hitMatIndex].color * ray.throughput;
+                continue;
+            }
+
+#if DEBUG_SELFINTERSECTION
+            if(result.hitId == ray.lastHitId) {
+                DebuggerBreak();
+            }
+#endif
+            
+            Material material = materials[result.hitMatIndex];
+            
+            //NOTE(ans): draws in the same order as ShadeHit, scrambles of all lights first and the bounce after them
+            data.series = ray.series;
+            
+            F32 specularWeight, diffuseWeight;
+            F32 shadedWeight = CalculateBounceWeights(material, ray.depth, options.diffuseBounce,
+                                                      &specularWeight, &diffuseWeight);
+            
+            if(shadedWeight > 0) {
+#if DEBUG_DISABLE_SHADING
+                *sampleColor = *sampleColor + material.color * (shadedWeight * ray.throughput);
+#else
+                F32 lightContribution = 1.0f / world->lightCount;
+                U32 lightSampleCount = GetLightSampleBudget(&shading, ray.depth, shadedWeight * ray.throughput);
+                for(U32 lightIndex = 0; lightIndex < world->lightCount; ++lightIndex) {
+                    LightTask* task = queues->lightTasks + taskCount++;
+                    task->hitPoint = result.hitPoint;
+                    task->hitNormal = result.hitNormal;
+                    task->weightedColor = material.color * (shadedWeight * ray.throughput * lightContribution);
+                    task->objectId = result.hitId;
+                    task->lightIndex = lightIndex;
+                    task->sampleIndex = ray.sampleIndex;
+                    task->scramble = RandomLightSampleScramble(&data.series);
+                    task->sampleCount = lightSampleCount;
+                    task->tracedCount = 0;
+                    task->visibleCount = 0;
+                    
+                    //NOTE(ans): a cached task adds its light scaled by the visibility right away and gives its slot back
+                    F32 cachedVisibility;
+                    if(shading.visibilityCache &&
+                       LookupVisibilityCache(shading.visibilityCache, world,
+                                             lightIndex, result.hitId, result.hitPoint,
+                                             options.sampleDataBuffer, &data.stats,
+                                             &cachedVisibility)) {
+                        task->weightedColor = task->weightedColor * cachedVisibility;
+                        EmitLightTaskSamples(&data, --taskCount, 0, task->sampleCount, false);
+                        
+                        ++data.stats.visibilityCacheShadingCount;
+                        ++data.stats.lightShadingCount;
+                    }
+                }
+#endif
+            }
+            
+            F32 throughput = ray.throughput;
+            V3 newRayDirection;
+            if(NextBounce(result.hitNormal, ray.direction,
+                          specularWeight, diffuseWeight,
+                          &shading,
+                          &throughput, &newRayDirection)) {
+                WavefrontRay* nextRay = queues->nextRays + nextRayCount++;
+                nextRay->origin = result.hitPoint;
+                nextRay->direction = newRayDirection;
+                nextRay->throughput = throughput;
+                nextRay->sampleIndex = ray.sampleIndex;
+                nextRay->depth = ray.depth + 1;
+                nextRay->lastHitId = result.hitId;
+                nextRay->series = data.series;
+            }
+        }
+        
+        ProcessLightTasks(&data, taskCount);
+        
+        WavefrontRay* swap = queues->rays;
+        queues->rays = queues->nextRays;
+        queues->nextRays = swap;
+        rayCount = nextRayCount;
+    }
+    
+    F32 contribution = 1.0f / samplesPerPixel;
+    for(U32 tileY = 0; tileY < tile.height; ++tileY) {
+        for(U32 tileX = 0; tileX < tile.width; ++tileX) {
+            U32 firstSample = (tileY * tile.width + tileX) * samplesPerPixel;
+            
+            V3 pixel = {};
+            for(U32 sampleIndex = 0; sampleIndex < samplesPerPixel; ++sampleIndex) {
+                pixel = pixel + (queues->sampleColors[firstSample + sampleIndex] * contribution);
+            }
+            
+            U32 pixelIndex = (tile.y + tileY - data.pixelRowOffset) * data.imageWidth + (tile.x + tileX);
+            data.hdrPixelData[pixelIndex] = pixel;
+        }
+    }
+}
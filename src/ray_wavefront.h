@@ -0,0 +1,74 @@
+/*
+Wavefront
+
+Instead of following one sample through all of its bounces and shadow rays, a tile keeps
+queues of rays that are in the same stage. every queue is sorted by direction and traced as a
+batch, 8 rays at a time.
+*/
+
+//NOTE(ans): one ray in flight, sampleIndex points into the sample colors of the tile
+struct WavefrontRay {
+    V3 origin;
+    V3 direction;
+    F32 throughput;
+    U32 sampleIndex;
+    U32 depth;
+    U32 lastHitId;
+    
+    //NOTE(ans): the series of the sample travels with its rays, the queue order does not change the random numbers
+    RandomSeries series;
+};
+
+//NOTE(ans): one light of one hit, keeps everything the adaptive second phase needs
+struct LightTask {
+    V3 hitPoint;
+    V3 hitNormal;
+    //NOTE(ans): material color * shaded weight * throughput * light contribution
+    V3 weightedColor;
+    U32 objectId;
+    U32 lightIndex;
+    U32 sampleIndex;
+    //NOTE(ans): the second phase continues the sobol sequence of the pilot with the same scramble
+    LightSampleScramble scramble;
+    //NOTE(ans): from GetLightSampleBudget, hits after a few bounces take fewer samples
+    U32 sampleCount;
+    
+    U32 tracedCount;
+    U32 visibleCount;
+};
+
+struct ShadowRay {
+    V3 origin;
+    V3 direction;
+    F32 maxDistance;
+    U32 ignoreId;
+    U32 taskIndex;
+    V3 contribution;
+};
+
+#define WAVEFRONT_SHADOW_QUEUE_SIZE 8192
+
+//NOTE(ans): per thread, sized for one tile and reused for every tile
+struct WavefrontQueues {
+    U32 sampleCapacity;
+    WavefrontRay* rays;
+    WavefrontRay* nextRays;
+    ShootRayResult* hits;
+    V3* sampleColors;
+    
+    U32 lightTaskCapacity;
+    LightTask* lightTasks;
+    
+    ShadowRay* shadowRays;
+    U32 shadowRayCount;
+    
+    //NOTE(ans): sort key in the high 32 bit, queue index in the low 32 bit
+    U32 sortCapacity;
+    U64* sortItems;
+    U64* sortTemp;
+};
+
+//NOTE(ans): defined in ray_wavefront.cpp, which comes after ray_tracing.cpp
+static void ReserveWavefrontQueues(WavefrontQueues* queues, U32 sampleCapacity, U32 lightCount);
+static void FreeWavefrontQueues(WavefrontQueues* queues);
+static void RayTraceTileWavefront(RayTraceThreadData* dataPointer, RenderTile tile);
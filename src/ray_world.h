@@ -47,6 +47,23 @@ struct Light {
     };
 };
 
+//NOTE(ans): 
+// structure of arrays copy of the geometry for the intersection kernels,
+// every array is padded by LANE_WIDTH so a kernel can always load full lanes
+struct SphereLanes {
+    F32* x;
+    F32* y;
+    F32* z;
+    F32* radiusSquared;
+};
+
+struct PlaneLanes {
+    F32* nx;
+    F32* ny;
+    F32* nz;
+    F32* d;
+};
+
 struct World {
     Material* materials;
     
@@ -56,6 +73,12 @@ struct World {
     Sphere* spheres;
     U32 sphereCount; 
     
+    //NOTE(ans): built by BuildWorldAcceleration, which reorders spheres to match the leaves
+    BVHNode* sphereNodes;
+    U32 sphereNodeCount;
+    SphereLanes sphereLanes;
+    PlaneLanes planeLanes;
+    
     Light* lights;
     U32 lightCount;
     